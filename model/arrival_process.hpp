@@ -0,0 +1,255 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CADMIUM_CELLDEVS_CO2_ARRIVAL_PROCESS_HPP
+#define CADMIUM_CELLDEVS_CO2_ARRIVAL_PROCESS_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "random_stream.hpp"
+
+using nlohmann::json;
+
+/*
+ * Shopper arrivals as a (non-homogeneous) Poisson process, read from the "arrivals" entry of the scenario block:
+ *   "arrivals": {
+ *       "profile": [{"from": 0, "rate": 0.05}, {"from": 300, "rate": 0.4}, {"from": 500, "rate": 0.05}],
+ *       "period": 1000,
+ *       "limit": 200,
+ *       "capacity": 40,
+ *       "entrances": [{"name": "front", "cell": [23, 5], "weight": 2}, {"name": "side", "cell": [3, 1]}],
+ *       "checkouts": [{"name": "till", "cell": [24, 5]}]
+ *   }
+ * The profile gives the mean arrivals per time unit from each time on (a constant "rate" can be given instead),
+ * and repeats every period (e.g. one day) if there is one. The other entries are optional:
+ * - limit: total arrivals (default: totalStudents of the CO2_cell configuration)
+ * - capacity: shoppers inside the store at the same time (default: half the cells of the shopping areas)
+ * - entrances: AIR cells where the shoppers appear, picked at random in proportion to their weight (default 1)
+ * - checkouts: cells the shoppers leave through, from the AIR cells next to them; they go to the closest one
+ * Without entrances or checkouts the shoppers use the first door of the store.
+ *
+ * The arrival times are drawn from their own random stream, by inverting the integrated rate, so they only depend
+ * on the seed. An arrival that finds its entrance taken or the store full waits at the entrance.
+ */
+class arrival_process {
+public:
+    struct rate_change {
+        double from; //Time from which the rate applies
+        double rate; //Mean arrivals per time unit
+    };
+
+    struct named_cell {
+        std::string name;
+        std::pair<int,int> cell;
+        double weight = 1; //Share of the arrivals (entrances only)
+        long count = 0; //Shoppers that came in or left through the cell
+        long waiting = 0; //Arrivals waiting to come in (entrances only)
+    };
+
+    std::vector<rate_change> profile;
+    double period = 0; //The profile repeats every period, 0 for no repetition
+    long limit = -1; //Total arrivals, -1 for totalStudents
+    int capacity = -1; //Shoppers in the store at the same time, -1 for half the cells of the shopping areas
+    std::vector<named_cell> entrances;
+    std::vector<named_cell> checkouts;
+
+    static arrival_process from_json(json const &j) {
+        arrival_process res;
+        if (j.contains("profile")) {
+            for (auto const &change : j.at("profile")) {
+                res.profile.push_back({change.at("from").get<double>(), change.at("rate").get<double>()});
+            }
+        } else {
+            res.profile.push_back({0, j.at("rate").get<double>()});
+        }
+        if (res.profile.empty() || res.profile.front().from != 0) {
+            throw std::invalid_argument("the arrival profile must start at time 0");
+        }
+        for (std::size_t i = 0; i < res.profile.size(); i++) {
+            if (res.profile[i].rate < 0 || (i > 0 && res.profile[i].from <= res.profile[i - 1].from)) {
+                throw std::invalid_argument("the arrival profile must have increasing times and non-negative rates");
+            }
+        }
+        if (j.contains("period")) {
+            res.period = j.at("period").get<double>();
+            if (res.period <= res.profile.back().from) {
+                throw std::invalid_argument("the arrival period must be longer than the profile");
+            }
+        }
+        if (j.contains("limit")) {
+            res.limit = j.at("limit").get<long>();
+        }
+        if (j.contains("capacity")) {
+            res.capacity = j.at("capacity").get<int>();
+        }
+        res.entrances = cells(j, "entrances");
+        res.checkouts = cells(j, "checkouts");
+        for (auto const &entrance : res.entrances) {
+            if (entrance.weight <= 0) {
+                throw std::invalid_argument("the weight of entrance " + entrance.name + " must be positive");
+            }
+        }
+        return res;
+    }
+
+    /*
+     * return: the time of the next arrival, infinity if there are no more
+     */
+    [[nodiscard]] double next_time() const {
+        return next;
+    }
+
+    /*
+     * return: the number of arrivals so far
+     */
+    [[nodiscard]] long arrived() const {
+        return arrivals;
+    }
+
+    /*
+     * Draw the time of the first arrival. Every later one is drawn when the previous one comes.
+     */
+    void start(uint64_t seed, long total) {
+        random = random_stream(seed, stream_key);
+        if (limit < 0) {
+            limit = total;
+        }
+        arrivals = 0;
+        next = (limit > 0)? after(0, -std::log(random.real(0))) : infinity;
+    }
+
+    /*
+     * Take the next arrival and draw the time of the following one
+     *
+     * return: the entrance of the arrival
+     */
+    named_cell &arrive() {
+        double total = 0;
+        for (auto const &entrance : entrances) {
+            total += entrance.weight;
+        }
+        double pick = random.real(arrivals, 1) * total;
+        std::size_t chosen = 0;
+        while (chosen + 1 < entrances.size() && pick > entrances[chosen].weight) {
+            pick -= entrances[chosen++].weight;
+        }
+        arrivals++;
+        next = (arrivals < limit)? after(next, -std::log(random.real(arrivals))) : infinity;
+        return entrances[chosen];
+    }
+
+    /*
+     * Restore the arrivals of a checkpoint (start must be called first)
+     */
+    void restore(long arrived, double next_arrival) {
+        arrivals = arrived;
+        next = next_arrival;
+    }
+
+private:
+    static constexpr double infinity = std::numeric_limits<double>::infinity();
+    static constexpr uint64_t stream_key = ~(uint64_t) 0; //Shoppers use their ID as key
+
+    static std::vector<named_cell> cells(json const &j, std::string const &key) {
+        std::vector<named_cell> res;
+        if (!j.contains(key)) {
+            return res;
+        }
+        for (auto const &c : j.at(key)) {
+            named_cell cell;
+            cell.name = c.at("name").get<std::string>();
+            auto position = c.at("cell").get<std::vector<int>>();
+            if (position.size() != 2) {
+                throw std::invalid_argument("the cell of " + cell.name + " must be [x, y]");
+            }
+            cell.cell = {position[0], position[1]};
+            if (c.contains("weight")) {
+                cell.weight = c.at("weight").get<double>();
+            }
+            res.push_back(cell);
+        }
+        return res;
+    }
+
+    /*
+     * return: the time at which the integrated rate from the given time reaches mass
+     */
+    [[nodiscard]] double after(double time, double mass) const {
+        double offset = 0; //Start of the current repetition of the profile
+        if (period > 0) {
+            if (period_mass() <= 0) {
+                return infinity;
+            }
+            offset = std::floor(time / period) * period;
+            time -= offset;
+        }
+        while (true) {
+            for (std::size_t i = 0; i < profile.size(); i++) {
+                double end = (i + 1 < profile.size())? profile[i + 1].from : (period > 0)? period : infinity;
+                if (end <= time) {
+                    continue;
+                }
+                double from = std::max(time, profile[i].from);
+                double rate = profile[i].rate;
+                if (rate > 0 && (end == infinity || rate * (end - from) >= mass)) {
+                    return offset + from + mass / rate;
+                }
+                if (end == infinity) {
+                    return infinity;
+                }
+                mass -= rate * (end - from);
+                time = end;
+            }
+            offset += period;
+            time = 0;
+        }
+    }
+
+    /*
+     * return: the mean arrivals of one repetition of the profile
+     */
+    [[nodiscard]] double period_mass() const {
+        double mass = 0;
+        for (std::size_t i = 0; i < profile.size(); i++) {
+            double end = (i + 1 < profile.size())? profile[i + 1].from : period;
+            mass += profile[i].rate * (end - profile[i].from);
+        }
+        return mass;
+    }
+
+    random_stream random = random_stream(0, stream_key);
+    long arrivals = 0;
+    double next = infinity;
+};
+
+#endif //CADMIUM_CELLDEVS_CO2_ARRIVAL_PROCESS_HPP
@@ -0,0 +1,467 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CADMIUM_CELLDEVS_CO2_BINARY_STATE_LOG_HPP
+#define CADMIUM_CELLDEVS_CO2_BINARY_STATE_LOG_HPP
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "co2_observers.hpp"
+#include "varint.hpp"
+
+/*
+ * Compact binary state log.
+ *
+ * File layout (integers are LEB128 varints, signed values are zigzag encoded, times are raw little endian doubles):
+ *   header:  "CO2B" version width height depth keyframe_interval
+ *   frames:  type ('K' keyframe or 'D' delta) time payload_size payload
+ *            keyframe payload: counter, concentration and type of every cell (index (x * height + y) * depth + z)
+ *            delta payload:    number of changed cells, then for each one the gap to the previous changed index
+ *                              and the differences of counter, concentration and type with its previous state
+ *   index:   number of keyframes, then time and file offset of each keyframe
+ *   footer:  offset of the index (8 bytes) "CO2I"
+ * The first frame is a keyframe with the initial states (or the states of the checkpoint of a resumed run). Another keyframe follows every keyframe_interval deltas,
+ * at the same time as the last delta, so readers can start from any keyframe.
+ * Version 1 logs have no depth (2D lattices only); the reader still accepts them.
+ */
+namespace co2_binary {
+    static constexpr char magic[4] = {'C', 'O', '2', 'B'};
+    static constexpr char index_magic[4] = {'C', 'O', '2', 'I'};
+    static constexpr uint8_t version = 2;
+}
+
+/*
+ * Observer that writes the binary state log from a background thread.
+ * The simulation thread only groups the changes of each time step into a frame and queues it;
+ * the queue is bounded, so the simulation waits if the disk cannot keep up.
+ */
+class binary_state_writer : public co2_observer {
+public:
+    explicit binary_state_writer(std::string const &file_path, int keyframe_interval = 100, std::size_t queue_capacity = 256) :
+            out(file_path, std::ios::binary), keyframe_interval(std::max(1, keyframe_interval)), capacity(std::max<std::size_t>(1, queue_capacity)) {
+        if (!out) {
+            throw std::runtime_error("cannot open " + file_path);
+        }
+    }
+
+    ~binary_state_writer() override {
+        finish(last_time);
+    }
+
+    /*
+     * The first keyframe of a resumed run holds the states of the checkpoint, at its time
+     */
+    void resume(double time) override {
+        start_time = time;
+    }
+
+    void shape(int width, int height, int depth) override {
+        this->width = width;
+        this->height = height;
+        this->depth = depth;
+    }
+
+    /*
+     * Without shape the size of the lattice is inferred from the initial states
+     */
+    void initial_state(int x, int y, int z, co2 const &state) override {
+        if (x < 0 || y < 0 || z < 0) {
+            return;
+        }
+        initial.push_back({{x, y, z}, state});
+        width = std::max(width, x + 1);
+        height = std::max(height, y + 1);
+        depth = std::max(depth, z + 1);
+    }
+
+    void state_change(double time, int x, int y, int z, co2 const &state) override {
+        start();
+        if (x < 0 || y < 0 || z < 0 || x >= width || y >= height || z >= depth) {
+            return;
+        }
+        if (time != current.time && !current.changes.empty()) {
+            push(std::move(current));
+            current = frame();
+        }
+        current.time = time;
+        current.changes.emplace_back((x * height + y) * depth + z, state);
+        last_time = time;
+    }
+
+    void finish(double /*time*/) override {
+        if (finished) {
+            return;
+        }
+        start();
+        if (!current.changes.empty()) {
+            push(std::move(current));
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        not_empty.notify_all();
+        writer.join();
+        finished = true;
+    }
+
+    [[nodiscard]] uint64_t bytes_written() const {
+        return written;
+    }
+
+private:
+    struct frame {
+        double time = 0;
+        std::vector<std::pair<int, co2>> changes; //Cell index and new state
+    };
+
+    /*
+     * Write the header and the initial keyframe, then start the background thread
+     */
+    void start() {
+        if (started) {
+            return;
+        }
+        started = true;
+        previous.assign((std::size_t) width * height * depth, co2(-1, 0, IMPERMEABLE_STRUCTURE));
+        for (auto const &cell : initial) {
+            previous[((std::size_t) cell.first[0] * height + cell.first[1]) * depth + cell.first[2]] = cell.second;
+        }
+        initial.clear();
+
+        std::string header(co2_binary::magic, 4);
+        header.push_back((char) co2_binary::version);
+        co2_binary::put_varint(header, width);
+        co2_binary::put_varint(header, height);
+        co2_binary::put_varint(header, depth);
+        co2_binary::put_varint(header, keyframe_interval);
+        write(header);
+        write_keyframe(start_time);
+        writer = std::thread([this]() { run(); });
+    }
+
+    void push(frame &&f) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this]() { return queue.size() < capacity; });
+        queue.push_back(std::move(f));
+        lock.unlock();
+        not_empty.notify_one();
+    }
+
+    /*
+     * Background thread: encode and write the queued frames
+     */
+    void run() {
+        while (true) {
+            frame f;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                not_empty.wait(lock, [this]() { return closed || !queue.empty(); });
+                if (queue.empty()) {
+                    break;
+                }
+                f = std::move(queue.front());
+                queue.pop_front();
+            }
+            not_full.notify_one();
+            write_delta(f);
+            if (++deltas % keyframe_interval == 0) {
+                write_keyframe(f.time);
+            }
+        }
+        write_index();
+        out.flush();
+    }
+
+    void write_delta(frame &f) {
+        //Sorted by cell; if a cell changed twice in the same time step only the last state is kept
+        std::stable_sort(f.changes.begin(), f.changes.end(),
+                         [](auto const &a, auto const &b) { return a.first < b.first; });
+        std::string payload;
+        std::size_t count = 0;
+        for (std::size_t i = 0; i < f.changes.size(); i++) {
+            if (i + 1 == f.changes.size() || f.changes[i + 1].first != f.changes[i].first) {
+                count++;
+            }
+        }
+        co2_binary::put_varint(payload, count);
+        int last_index = -1;
+        for (std::size_t i = 0; i < f.changes.size(); i++) {
+            if (i + 1 < f.changes.size() && f.changes[i + 1].first == f.changes[i].first) {
+                continue;
+            }
+            int index = f.changes[i].first;
+            co2 const &state = f.changes[i].second;
+            co2 &before = previous[index];
+            co2_binary::put_varint(payload, index - last_index - 1);
+            co2_binary::put_signed(payload, (int64_t) state.counter - before.counter);
+            co2_binary::put_signed(payload, (int64_t) state.concentration - before.concentration);
+            co2_binary::put_signed(payload, (int64_t) state.type - before.type);
+            before = state;
+            last_index = index;
+        }
+        write_frame('D', f.time, payload);
+    }
+
+    void write_keyframe(double time) {
+        std::string payload;
+        for (co2 const &state : previous) {
+            co2_binary::put_signed(payload, state.counter);
+            co2_binary::put_signed(payload, state.concentration);
+            co2_binary::put_signed(payload, state.type);
+        }
+        keyframes.emplace_back(time, written);
+        write_frame('K', time, payload);
+    }
+
+    void write_frame(char type, double time, std::string const &payload) {
+        std::string head(1, type);
+        co2_binary::put_double(head, time);
+        co2_binary::put_varint(head, payload.size());
+        write(head);
+        write(payload);
+    }
+
+    void write_index() {
+        uint64_t index_offset = written;
+        std::string index;
+        co2_binary::put_varint(index, keyframes.size());
+        for (auto const &keyframe : keyframes) {
+            co2_binary::put_double(index, keyframe.first);
+            co2_binary::put_u64(index, keyframe.second);
+        }
+        co2_binary::put_u64(index, index_offset);
+        index.append(co2_binary::index_magic, 4);
+        write(index);
+    }
+
+    void write(std::string const &bytes) {
+        out.write(bytes.data(), (std::streamsize) bytes.size());
+        written += bytes.size();
+    }
+
+    std::ofstream out;
+    int keyframe_interval;
+    std::size_t capacity;
+    int width = 0;
+    int height = 0;
+    int depth = 1;
+    std::vector<std::pair<std::array<int,3>, co2>> initial;
+    bool started = false;
+    bool finished = false;
+    double start_time = 0;
+    double last_time = 0;
+    frame current;
+
+    // Shared with the background thread
+    std::mutex mutex;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+    std::deque<frame> queue;
+    bool closed = false;
+    std::thread writer;
+
+    // Only used by the background thread once it started
+    std::vector<co2> previous; //Last state written for every cell
+    std::vector<std::pair<double, uint64_t>> keyframes; //Time and offset of every keyframe
+    long deltas = 0;
+    uint64_t written = 0;
+};
+
+/*
+ * Reads a binary state log frame by frame. seek() jumps to the state of any time through the keyframe index.
+ */
+class binary_state_reader {
+public:
+    explicit binary_state_reader(std::string const &file_path) {
+        std::ifstream in(file_path, std::ios::binary);
+        if (!in) {
+            throw std::runtime_error("cannot open " + file_path);
+        }
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        co2_binary::cursor c{bytes.data(), bytes.size()};
+        if (bytes.size() < 5 || std::memcmp(bytes.data(), co2_binary::magic, 4) != 0) {
+            throw std::runtime_error(file_path + " is not a binary state log");
+        }
+        c.pos = 4;
+        uint8_t file_version = bytes[c.pos++];
+        if (file_version < 1 || file_version > co2_binary::version) {
+            throw std::runtime_error("unsupported binary state log version");
+        }
+        width = (int) c.varint();
+        height = (int) c.varint();
+        depth = file_version >= 2 ? (int) c.varint() : 1;
+        keyframe_interval = (int) c.varint();
+        first_frame = c.pos;
+        end = bytes.size();
+        read_index();
+        grid.assign((std::size_t) width * height * depth, co2(-1, 0, IMPERMEABLE_STRUCTURE));
+        position = first_frame;
+    }
+
+    /*
+     * Read the next frame and apply it to the grid
+     *
+     * return false at the end of the log
+     */
+    bool next() {
+        if (position >= end) {
+            return false;
+        }
+        co2_binary::cursor c{bytes.data(), end, position};
+        char type = bytes[c.pos++];
+        frame_time = c.real();
+        std::size_t size = c.varint();
+        std::size_t payload_end = c.pos + size;
+        if (payload_end > end) {
+            throw std::runtime_error("truncated frame");
+        }
+        c.size = payload_end;
+        changed.clear();
+        keyframe = type == 'K';
+        if (keyframe) {
+            for (co2 &state : grid) {
+                state.counter = (int) c.signed_varint();
+                state.concentration = (int) c.signed_varint();
+                state.type = (CELL_TYPE) c.signed_varint();
+            }
+        } else {
+            std::size_t count = c.varint();
+            int index = -1;
+            for (std::size_t i = 0; i < count; i++) {
+                index += (int) c.varint() + 1;
+                co2 &state = grid.at(index);
+                state.counter += (int) c.signed_varint();
+                state.concentration += (int) c.signed_varint();
+                state.type = (CELL_TYPE) (state.type + c.signed_varint());
+                changed.push_back(index);
+            }
+        }
+        position = payload_end;
+        return true;
+    }
+
+    /*
+     * return: the time of the next frame, or infinity at the end of the log
+     */
+    [[nodiscard]] double next_time() const {
+        if (position >= end) {
+            return std::numeric_limits<double>::infinity();
+        }
+        co2_binary::cursor c{bytes.data(), end, position + 1};
+        return c.real();
+    }
+
+    /*
+     * Position the reader on the last keyframe at or before the given time and load it.
+     * Call next() to continue with the following frames.
+     */
+    void seek(double time) {
+        position = first_frame;
+        auto it = std::upper_bound(keyframes.begin(), keyframes.end(), time,
+                                   [](double t, auto const &keyframe) { return t < keyframe.first; });
+        if (it != keyframes.begin()) {
+            position = (std::prev(it))->second;
+        }
+        next();
+    }
+
+    [[nodiscard]] co2 const &state(int x, int y, int z = 0) const {
+        return grid[((std::size_t) x * height + y) * depth + z];
+    }
+
+    int width = 0;
+    int height = 0;
+    int depth = 1;
+    int keyframe_interval = 0;
+    double frame_time = 0; //Time of the last frame read
+    bool keyframe = false; //True if the last frame read was a keyframe
+    std::vector<int> changed; //Cells changed by the last delta frame (index (x * height + y) * depth + z)
+
+private:
+    /*
+     * Load the keyframe index. Logs without index (e.g. the simulation was killed) are scanned instead.
+     */
+    void read_index() {
+        if (bytes.size() >= first_frame + 12 && std::memcmp(bytes.data() + bytes.size() - 4, co2_binary::index_magic, 4) == 0) {
+            co2_binary::cursor footer{bytes.data(), bytes.size() - 4, bytes.size() - 12};
+            std::size_t index_offset = footer.u64();
+            if (index_offset >= first_frame && index_offset < bytes.size()) {
+                co2_binary::cursor c{bytes.data(), bytes.size() - 12, index_offset};
+                std::size_t count = c.varint();
+                for (std::size_t i = 0; i < count; i++) {
+                    double time = c.real();
+                    keyframes.emplace_back(time, c.u64());
+                }
+                end = index_offset;
+                return;
+            }
+        }
+        std::size_t pos = first_frame;
+        while (pos < end) {
+            co2_binary::cursor c{bytes.data(), end, pos};
+            char type = bytes[c.pos++];
+            double time;
+            std::size_t size;
+            try {
+                time = c.real();
+                size = c.varint();
+            } catch (std::runtime_error const &) {
+                break;
+            }
+            if (c.pos + size > end) {
+                break;
+            }
+            if (type == 'K') {
+                keyframes.emplace_back(time, pos);
+            }
+            pos = c.pos + size;
+        }
+        end = pos;
+    }
+
+    std::string bytes;
+    std::size_t first_frame = 0;
+    std::size_t end = 0;
+    std::size_t position = 0;
+    std::vector<co2> grid;
+    std::vector<std::pair<double, std::size_t>> keyframes;
+};
+
+#endif //CADMIUM_CELLDEVS_CO2_BINARY_STATE_LOG_HPP
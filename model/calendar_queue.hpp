@@ -0,0 +1,148 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CADMIUM_CELLDEVS_CO2_CALENDAR_QUEUE_HPP
+#define CADMIUM_CELLDEVS_CO2_CALENDAR_QUEUE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+using co2_tick = int64_t; //Simulation time in whole time units
+
+/*
+ * Calendar queue (bucket queue) for events at integer ticks.
+ *
+ * The transport delays of the model are small integers (1 or resp_time), so every pending event is within a few
+ * ticks of the current time. The queue is a ring of buckets, one per tick, that covers at least the span between the
+ * earliest and the latest pending event; pushing and popping are O(1), and popping only skips the empty buckets
+ * between two event times. Events at the same tick come out in the order they were pushed.
+ * The ring grows (to the next power of two) if an event is pushed beyond its span.
+ */
+template <typename T>
+class calendar_queue {
+public:
+    explicit calendar_queue(std::size_t buckets = 8) {
+        std::size_t size = 1;
+        while (size < buckets) {
+            size *= 2;
+        }
+        ring.resize(size);
+    }
+
+    void push(co2_tick time, T const &value) {
+        if (count == 0) {
+            first = time;
+        } else if (time < first || time - first >= (co2_tick) ring.size()) {
+            grow(time);
+        }
+        ring[slot(time)].events.push_back(value);
+        count++;
+    }
+
+    [[nodiscard]] bool empty() const {
+        return count == 0;
+    }
+
+    [[nodiscard]] std::size_t size() const {
+        return count;
+    }
+
+    /*
+     * return: the tick of the earliest event (the queue must not be empty)
+     */
+    [[nodiscard]] co2_tick next_time() const {
+        return first;
+    }
+
+    /*
+     * return: the earliest event, the first one pushed if several share its tick (the queue must not be empty)
+     */
+    [[nodiscard]] T const &top() const {
+        bucket const &b = ring[slot(first)];
+        return b.events[b.head];
+    }
+
+    void pop() {
+        bucket &b = ring[slot(first)];
+        if (++b.head == b.events.size()) {
+            b.events.clear();
+            b.head = 0;
+            if (--count > 0) {
+                do {
+                    first++;
+                } while (ring[slot(first)].events.empty());
+            }
+            return;
+        }
+        count--;
+    }
+
+private:
+    struct bucket {
+        std::vector<T> events;
+        std::size_t head = 0; //Next event to pop
+    };
+
+    [[nodiscard]] std::size_t slot(co2_tick time) const {
+        return (std::size_t) time & (ring.size() - 1);
+    }
+
+    /*
+     * Grow the ring to cover the pending events and the new time
+     */
+    void grow(co2_tick time) {
+        co2_tick low = std::min(first, time);
+        co2_tick high = first;
+        for (co2_tick t = first; t < first + (co2_tick) ring.size(); t++) {
+            if (!ring[slot(t)].events.empty()) {
+                high = t;
+            }
+        }
+        high = std::max(high, time);
+        std::size_t size = ring.size();
+        while ((co2_tick) size <= high - low) {
+            size *= 2;
+        }
+        std::vector<bucket> old(size);
+        old.swap(ring);
+        for (co2_tick t = first; t < first + (co2_tick) old.size(); t++) {
+            bucket &b = old[(std::size_t) t & (old.size() - 1)];
+            if (!b.events.empty()) {
+                ring[slot(t)].events.assign(b.events.begin() + (std::ptrdiff_t) b.head, b.events.end());
+            }
+        }
+        first = low;
+    }
+
+    std::vector<bucket> ring;
+    std::size_t count = 0;
+    co2_tick first = 0; //Tick of the earliest event
+};
+
+#endif //CADMIUM_CELLDEVS_CO2_CALENDAR_QUEUE_HPP
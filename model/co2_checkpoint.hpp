@@ -0,0 +1,116 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CADMIUM_CELLDEVS_CO2_CHECKPOINT_HPP
+#define CADMIUM_CELLDEVS_CO2_CHECKPOINT_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include "co2_state.hpp"
+#include "varint.hpp"
+
+/*
+ * Snapshot of the simulation state ("CO2C" version 3, then the values in the order they were written).
+ * Integers are zigzag varints, so the cell states and the shopper records take a few bytes each.
+ */
+class checkpoint_writer {
+public:
+    void integer(int64_t value) {
+        co2_binary::put_signed(bytes, value);
+    }
+
+    void real(double value) {
+        co2_binary::put_double(bytes, value);
+    }
+
+    void state(co2 const &s) {
+        integer(s.counter);
+        integer(s.concentration);
+        integer(s.type);
+    }
+
+    void save(std::string const &file_path) const {
+        std::ofstream out(file_path, std::ios::binary);
+        if (!out) {
+            throw std::runtime_error("cannot open " + file_path);
+        }
+        out.write(magic, 4);
+        out.put((char) version);
+        out.write(bytes.data(), (std::streamsize) bytes.size());
+        if (!out) {
+            throw std::runtime_error("cannot write " + file_path);
+        }
+    }
+
+    static constexpr char magic[4] = {'C', 'O', '2', 'C'};
+    static constexpr uint8_t version = 3;
+
+private:
+    std::string bytes;
+};
+
+class checkpoint_reader {
+public:
+    explicit checkpoint_reader(std::string const &file_path) {
+        std::ifstream in(file_path, std::ios::binary);
+        if (!in) {
+            throw std::runtime_error("cannot open " + file_path);
+        }
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        if (bytes.size() < 5 || bytes.compare(0, 4, checkpoint_writer::magic, 4) != 0) {
+            throw std::runtime_error(file_path + " is not a checkpoint");
+        }
+        if ((uint8_t) bytes[4] != checkpoint_writer::version) {
+            throw std::runtime_error("unsupported checkpoint version");
+        }
+        c = {bytes.data(), bytes.size(), 5};
+    }
+
+    int64_t integer() {
+        return c.signed_varint();
+    }
+
+    double real() {
+        return c.real();
+    }
+
+    co2 state() {
+        co2 s;
+        s.counter = (int) integer();
+        s.concentration = (int) integer();
+        s.type = (CELL_TYPE) integer();
+        return s;
+    }
+
+private:
+    std::string bytes;
+    co2_binary::cursor c{nullptr, 0};
+};
+
+#endif //CADMIUM_CELLDEVS_CO2_CHECKPOINT_HPP
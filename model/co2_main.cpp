@@ -28,17 +28,28 @@
 * Implemented in Cadmium-cell-DEVS by Cristina Ruiz Martin
 */
 
+#include <chrono>
+#include <cmath>
 #include <fstream>
+#include <sstream>
+#include <sys/resource.h>
+#include <boost/program_options.hpp>
 #include <cadmium/modeling/dynamic_coupled.hpp>
 #include <cadmium/engine/pdevs_dynamic_runner.hpp>
 #include <cadmium/logger/common_loggers.hpp>
 #include "co2_coupled.hpp"
+#include "co2_stencil.hpp"
+#include "co2_volume.hpp"
+#include "binary_state_log.hpp"
+#include "live_stream.hpp"
+#include "co2_metrics.hpp"
+#include "co2_probes.hpp"
 
 using namespace std;
 using namespace cadmium;
 using namespace cadmium::celldevs;
 
-using TIME = float;
+using TIME = double; //Whole time units stay exact up to 2^53 (float loses them after 2^24, about 194 days of seconds)
 
 /*************** Loggers *******************/
 static ofstream out_messages("results/output_messages.txt");
@@ -62,22 +73,341 @@ using global_time_sta=logger::logger<logger::logger_global_time, dynamic::logger
 using logger_top=logger::multilogger<state, log_messages, global_time_mes, global_time_sta>;
 
 
+/*
+ * add_lattice_json only reads the JSON format: raster layouts are expanded to results/scenario.json first
+ *
+ * return: the path of the scenario in the JSON format
+ */
+std::string lattice_json_file(std::string const &scenario_config_file_path, co2_scenario const &scenario) {
+    if (!co2_scenario::is_raster(scenario_config_file_path)) {
+        return scenario_config_file_path;
+    }
+    std::string json_path = "results/scenario.json";
+    ofstream out(json_path);
+    out << scenario.to_json();
+    return json_path;
+}
+
+/*
+ * The seed of the command line, else the seed of the scenario, else the current time
+ */
+void set_seed(shopper_engine &agents, std::optional<uint64_t> seed, co2_scenario const &scenario) {
+    agents.seed = seed.value_or(scenario.seed.value_or(agents.seed));
+    cout << "Seed: " << agents.seed << endl;
+}
+
+std::string probe_file; //CSV file of the probe readings, empty for none
+std::unique_ptr<co2_probe_log> probe_log;
+
+/*
+ * Log the probes of the scenario to probe_file, if there is one
+ */
+void add_probes(co2_scenario const &scenario) {
+    if (probe_file.empty()) {
+        return;
+    }
+    if (!scenario.probes) {
+        throw std::invalid_argument("the scenario has no probes");
+    }
+    probe_log = std::make_unique<co2_probe_log>(probe_file, *scenario.probes);
+    observers.add(probe_log.get());
+}
+
+/*
+ * Shoppers that came in through every entrance and left through every checkout of the arrival process
+ */
+void print_arrivals(shopper_engine const &agents) {
+    if (!agents.arrivals) {
+        return;
+    }
+    cout << "Arrivals: " << agents.arrivals->arrived() << " (entrances:";
+    for (auto const &entrance : agents.arrivals->entrances) {
+        cout << " " << entrance.name << " " << entrance.count;
+        if (entrance.waiting > 0) {
+            cout << " + " << entrance.waiting << " waiting";
+        }
+    }
+    cout << "; checkouts:";
+    for (auto const &checkout : agents.arrivals->checkouts) {
+        cout << " " << checkout.name << " " << checkout.count;
+    }
+    cout << ")" << endl;
+}
+
+/*
+ * Run the Cadmium cells. LOGGER is logger_top for the text logs, or not_logger when the states go to observers only.
+ */
+template <typename LOGGER>
+void run_cadmium(std::string const &scenario_config_file_path, double sim_time, std::optional<uint64_t> seed) {
+    co2_scenario scenario = co2_scenario::is_raster(scenario_config_file_path)?
+            co2_scenario::load_raster(scenario_config_file_path) : co2_scenario::load_json(scenario_config_file_path);
+    set_seed(shoppers, seed, scenario);
+    add_probes(scenario);
+    shoppers.arrivals = scenario.arrivals;
+    shoppers.reserve(scenario.width, scenario.height);
+    observers.shape(scenario.width, scenario.height, scenario.depth);
+
+    walls = lattice_walls(scenario);
+
+    //The lattice is built in place: copying the coupled model would briefly hold every cell twice
+    auto test = std::make_shared<co2_coupled<TIME>>("co2_lab");
+    test->add_lattice_json(lattice_json_file(scenario_config_file_path, scenario));
+    scenario = co2_scenario(); //Only the header was needed, the cells are in the lattice now
+    test->couple_cells();
+
+    std::shared_ptr<cadmium::dynamic::modeling::coupled<TIME>> t = test;
+
+    cadmium::dynamic::engine::runner<TIME, LOGGER> r(t, {0});
+    r.run_until(sim_time);
+    observers.finish(sim_time);
+
+    print_arrivals(shoppers);
+    cout << "Rule evaluations short-circuited: " << short_circuits.static_cells + short_circuits.steady_cells
+         << " (static cells: " << short_circuits.static_cells << ", steady cells: " << short_circuits.steady_cells << ")" << endl;
+    cout << "State changes below the quantum: " << short_circuits.quantized << endl;
+}
+
+/*
+ * Wall-clock time from the start of the program (reading the scenario and building the lattice included)
+ * to the first state change, and the peak memory of the process
+ */
+class startup_report : public co2_observer {
+public:
+    void state_change(double /*time*/, int /*x*/, int /*y*/, int /*z*/, co2 const &/*state*/) override {
+        if (!first_event) {
+            first_event = std::chrono::steady_clock::now();
+        }
+    }
+
+    void print() const {
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        cout << "Time to first event: ";
+        if (first_event) {
+            cout << std::chrono::duration<double>(*first_event - start).count() << " s";
+        } else {
+            cout << "none";
+        }
+        cout << " (peak memory: " << usage.ru_maxrss / 1024 << " MB)" << endl;
+    }
+
+private:
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::optional<std::chrono::steady_clock::time_point> first_event;
+};
+
+struct checkpoint_options {
+    double interval = 0; //Time between two checkpoints, 0 for none
+    std::string prefix; //The checkpoint of time T is written to PREFIX_T.bin
+    std::string resume; //Checkpoint to start from, empty to start from the scenario
+};
+
+void run_stencil(std::string const &scenario_config_file_path, double sim_time, int threads, bool text_log,
+                 std::optional<uint64_t> seed, checkpoint_options const &checkpoints, adaptive_options const &adaptive,
+                 int fast_forward) {
+    co2_scenario scenario = co2_scenario::from_file(scenario_config_file_path);
+    co2_stencil stencil(scenario, threads);
+    add_probes(scenario);
+    stencil.set_adaptive(adaptive);
+    stencil.set_fast_forward(fast_forward);
+    if (checkpoints.resume.empty()) {
+        set_seed(stencil.agents(), seed, scenario);
+    } else {
+        stencil.load(checkpoints.resume);
+        if (seed) {
+            stencil.agents().seed = *seed;
+        }
+        cout << "Resumed at " << stencil.time() << " (seed: " << stencil.agents().seed << ")" << endl;
+    }
+    scenario = co2_scenario(); //The engine keeps its own copy of the cells
+    text_state_log text(out_state);
+    if (text_log) {
+        observers.add(&text);
+    }
+    if (checkpoints.interval > 0) {
+        for (double t = (std::floor(stencil.time() / checkpoints.interval) + 1) * checkpoints.interval; t < sim_time;
+                t += checkpoints.interval) {
+            stencil.run_until(t, &observers);
+            ostringstream file_path;
+            file_path << checkpoints.prefix << "_" << t << ".bin";
+            stencil.save(file_path.str());
+        }
+    }
+    stencil.run_until(sim_time, &observers);
+    observers.finish(sim_time);
+
+    print_arrivals(stencil.agents());
+    cout << "Local computations: " << stencil.computations << " (state changes: " << stencil.state_changes << ")" << endl;
+    if (adaptive.block > 1) {
+        cout << "Coarse cells of " << adaptive.block << "x" << adaptive.block << ": " << stencil.coarse_cells << " at the end"
+             << " (merges: " << stencil.merges << ", splits: " << stencil.splits
+             << ", coarse computations: " << stencil.coarse_computations << ")" << endl;
+    }
+    if (fast_forward > 0) {
+        cout << "Fast-forwarded idle periods: " << stencil.fast_forwards << " (time steps: " << stencil.fast_forward_steps
+             << ", solver sweeps: " << stencil.fast_forward_sweeps << ")" << endl;
+    }
+}
+
+void run_volume(std::string const &scenario_config_file_path, double sim_time, bool text_log, std::optional<uint64_t> seed) {
+    co2_scenario scenario = co2_scenario::from_file(scenario_config_file_path, true);
+    std::size_t total_cells = (std::size_t) scenario.width * scenario.height * scenario.depth;
+    co2_volume volume(scenario);
+    set_seed(volume.agents(), seed, scenario);
+    add_probes(scenario);
+    scenario = co2_scenario(); //The engine keeps its own copy of the cells that are not solid
+    text_state_log text(out_state);
+    if (text_log) {
+        observers.add(&text);
+    }
+    volume.run_until(sim_time, &observers);
+    observers.finish(sim_time);
+
+    print_arrivals(volume.agents());
+    cout << "Stored cells: " << volume.stored_cells() << " of " << total_cells << " (" << volume.memory() << " bytes)" << endl;
+    cout << "Local computations: " << volume.computations << " (state changes: " << volume.state_changes << ")" << endl;
+}
+
 int main(int argc, char ** argv) {
-    if (argc < 2) {
+    startup_report startup;
+    namespace po = boost::program_options;
+    po::options_description options("Options");
+    options.add_options()
+        ("help,h", "print this message")
+        ("engine", po::value<std::string>()->default_value("cadmium"),
+            "simulation engine: cadmium (Cell-DEVS cells), stencil (synchronous flat arrays, 2D von Neumann only) "
+            "or volume (sparse arrays without the solid cells, 2D or 3D von Neumann)")
+        ("threads", po::value<int>()->default_value(1), "number of threads of the stencil engine")
+        ("seed", po::value<uint64_t>(), "seed of the random numbers (default: \"seed\" of the scenario, else the current time)")
+        ("log", po::value<std::string>()->default_value("text"),
+            "state log: text (results/state.txt), binary (delta-encoded, written by a background thread) or none")
+        ("log-file", po::value<std::string>()->default_value("results/state.bin"), "file of the binary state log")
+        ("checkpoint-interval", po::value<double>()->default_value(0),
+            "write a checkpoint every N time units (stencil engine only, 0 for none)")
+        ("checkpoint-prefix", po::value<std::string>()->default_value("results/checkpoint"),
+            "checkpoints are written to PREFIX_TIME.bin")
+        ("resume", po::value<std::string>(), "continue the simulation from a checkpoint of the same layout (stencil engine only)")
+        ("adaptive-block", po::value<int>()->default_value(0),
+            "simulate the quiescent blocks of NxN cells away from the shoppers as one coarse cell (stencil engine only, 0 for off)")
+        ("adaptive-threshold", po::value<int>()->default_value(10),
+            "concentration difference (ppm) within which a block is merged; larger differences split it again")
+        ("adaptive-interval", po::value<int>()->default_value(10), "time steps between two searches of blocks to merge")
+        ("fast-forward", po::value<int>()->default_value(0),
+            "solve the idle periods of at least N time steps (empty store, no CO2 source) instead of simulating them (stencil engine only, 0 for off)")
+        ("live", po::value<std::string>(), "publish the changes of every time step to this shared memory segment (e.g. /co2_live) for co2_live")
+        ("live-buffer", po::value<std::size_t>()->default_value(64), "size in MB of the live stream ring; a slow viewer gets merged time steps when it is full")
+        ("metrics", po::value<std::string>(), "write the mean and max CO2, the occupied cells and the cells above the threshold to this CSV file")
+        ("metrics-interval", po::value<double>()->default_value(10), "time between two rows of the metrics file")
+        ("metrics-threshold", po::value<int>()->default_value(1000), "CO2 concentration (ppm) counted by the metrics")
+        ("probes", po::value<std::string>(), "write the readings of the probes of the scenario to this CSV file");
+    po::options_description arguments;
+    arguments.add_options()
+        ("scenario", po::value<std::string>())
+        ("time", po::value<double>()->default_value(1000));
+    arguments.add(options);
+    po::positional_options_description positional;
+    positional.add("scenario", 1).add("time", 1);
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(arguments).positional(positional).run(), vm);
+        po::notify(vm);
+    } catch (po::error const &e) {
+        cout << e.what() << endl;
+        return -1;
+    }
+    if (vm.count("help") || !vm.count("scenario")) {
         cout << "Program used with wrong parameters. The program must be invoked as follows:";
-        cout << argv[0] << " SCENARIO_CONFIG.json [MAX_SIMULATION_TIME (default: 500)]" << endl;
+        cout << argv[0] << " SCENARIO_CONFIG.json|LAYOUT.map [MAX_SIMULATION_TIME (default: 1000)] [OPTIONS]" << endl;
+        cout << options << endl;
+        return -1;
+    }
+
+    std::string scenario_config_file_path = vm["scenario"].as<std::string>();
+    double sim_time = vm["time"].as<double>();
+    std::string engine = vm["engine"].as<std::string>();
+    std::string log = vm["log"].as<std::string>();
+    if (engine != "cadmium" && engine != "stencil" && engine != "volume") {
+        cout << "Unknown engine: " << engine << endl;
+        return -1;
+    }
+    if (log != "text" && log != "binary" && log != "none") {
+        cout << "Unknown state log: " << log << endl;
+        return -1;
+    }
+
+    checkpoint_options checkpoints;
+    checkpoints.interval = vm["checkpoint-interval"].as<double>();
+    checkpoints.prefix = vm["checkpoint-prefix"].as<std::string>();
+    if (vm.count("resume")) {
+        checkpoints.resume = vm["resume"].as<std::string>();
+    }
+    if (engine != "stencil" && (checkpoints.interval > 0 || !checkpoints.resume.empty())) {
+        cout << "Checkpoints are only supported by the stencil engine" << endl;
         return -1;
     }
 
-    co2_coupled<TIME> test = co2_coupled<TIME>("co2_lab");
-    std::string scenario_config_file_path = argv[1];
-    test.add_lattice_json(scenario_config_file_path);
-    test.couple_cells();
+    adaptive_options adaptive;
+    adaptive.block = vm["adaptive-block"].as<int>();
+    adaptive.threshold = vm["adaptive-threshold"].as<int>();
+    adaptive.interval = vm["adaptive-interval"].as<int>();
+    if (adaptive.block > 1 && (engine != "stencil" || checkpoints.interval > 0 || !checkpoints.resume.empty())) {
+        cout << "The adaptive mode is only supported by the stencil engine, without checkpoints" << endl;
+        return -1;
+    }
 
-    std::shared_ptr<cadmium::dynamic::modeling::coupled<TIME>> t = std::make_shared<co2_coupled<TIME>>(test);
+    int fast_forward = vm["fast-forward"].as<int>();
+    if (fast_forward > 0 && (engine != "stencil" || adaptive.block > 1)) {
+        cout << "The fast-forward is only supported by the stencil engine, without the adaptive mode" << endl;
+        return -1;
+    }
 
-    cadmium::dynamic::engine::runner<TIME, logger_top> r(t, {0});
-    float sim_time = (argc > 2)? atof(argv[2]) : 1000;
-    r.run_until(sim_time);
+    std::optional<uint64_t> seed;
+    if (vm.count("seed")) {
+        seed = vm["seed"].as<uint64_t>();
+    }
+
+    observers.add(&startup);
+    std::unique_ptr<binary_state_writer> binary_log;
+    if (log == "binary") {
+        binary_log = std::make_unique<binary_state_writer>(vm["log-file"].as<std::string>());
+        observers.add(binary_log.get());
+    }
+    std::unique_ptr<live_stream_writer> live;
+    if (vm.count("live")) {
+        live = std::make_unique<live_stream_writer>(vm["live"].as<std::string>(), vm["live-buffer"].as<std::size_t>() << 20);
+        observers.add(live.get());
+    }
+    std::unique_ptr<co2_metrics> metrics;
+    if (vm.count("metrics")) {
+        metrics = std::make_unique<co2_metrics>(vm["metrics"].as<std::string>(), vm["metrics-interval"].as<double>(),
+                                                vm["metrics-threshold"].as<int>());
+        observers.add(metrics.get());
+    }
+    if (vm.count("probes")) {
+        probe_file = vm["probes"].as<std::string>();
+    }
+    if (engine == "cadmium") {
+        if (log == "text") {
+            run_cadmium<logger_top>(scenario_config_file_path, sim_time, seed);
+        } else {
+            run_cadmium<logger::not_logger>(scenario_config_file_path, sim_time, seed);
+        }
+    } else if (engine == "volume") {
+        run_volume(scenario_config_file_path, sim_time, log == "text", seed);
+    } else {
+        run_stencil(scenario_config_file_path, sim_time, std::max(1, vm["threads"].as<int>()), log == "text", seed, checkpoints, adaptive, fast_forward);
+    }
+    if (binary_log != nullptr) {
+        cout << "Binary state log: " << binary_log->bytes_written() << " bytes" << endl;
+    }
+    if (live != nullptr) {
+        cout << "Live stream: " << live->frames() << " frames (time steps merged: " << live->merged_steps() << ")" << endl;
+    }
+    startup.print();
+#ifdef CO2_PROFILING
+    profile.write_json("results/profile.json");
+    cout << "Profile written to results/profile.json" << endl;
+#endif
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,237 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CADMIUM_CELLDEVS_CO2_METRICS_HPP
+#define CADMIUM_CELLDEVS_CO2_METRICS_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "co2_observers.hpp"
+
+/*
+ * Aggregate metrics of the air of the store, updated with every state change.
+ *
+ * The air cells are the AIR and CO2_SOURCE cells. The sums and counts are adjusted by the difference between the old
+ * and the new state of the changed cell, and the maximum comes from an ordered count of the concentrations,
+ * so a row costs the same whatever the size of the grid.
+ * One CSV row is written for every multiple of the interval, with the state after all the changes up to that time:
+ *   time,mean_co2,max_co2,occupied_cells,cells_above_<threshold>
+ * The times skipped by a fast-forward have no row, as their states are not known.
+ * The peaks of the reported values are kept for summaries (e.g. the ensemble runs).
+ */
+class co2_metrics : public co2_observer {
+public:
+    co2_metrics(std::string const &file_path, double interval, int threshold = 1000) :
+            co2_metrics(interval, threshold) {
+        file.open(file_path);
+        if (!file) {
+            throw std::runtime_error("cannot open " + file_path);
+        }
+        out = &file;
+        file << "time,mean_co2,max_co2,occupied_cells,cells_above_" << threshold << std::endl;
+    }
+
+    /*
+     * Metrics without CSV file, only the current values and the peaks
+     */
+    explicit co2_metrics(double interval, int threshold = 1000) : interval(interval), threshold(threshold) {
+        if (interval <= 0) {
+            throw std::invalid_argument("the metrics interval must be positive");
+        }
+    }
+
+    /*
+     * A resumed run reports from the first multiple of the interval at or after the checkpoint
+     */
+    void resume(double time) override {
+        reports = (long) std::ceil(time / interval);
+        next_report = reports * interval;
+    }
+
+    void shape(int width, int height, int depth) override {
+        this->width = width;
+        this->height = height;
+        this->depth = depth;
+    }
+
+    void initial_state(int x, int y, int z, co2 const &state) override {
+        if (x < 0 || y < 0 || z < 0) {
+            return;
+        }
+        initial.push_back({{x, y, z}, state});
+        width = std::max(width, x + 1);
+        height = std::max(height, y + 1);
+        depth = std::max(depth, z + 1);
+    }
+
+    void state_change(double time, int x, int y, int z, co2 const &state) override {
+        start();
+        report_before(time);
+        if (x < 0 || y < 0 || z < 0 || x >= width || y >= height || z >= depth) {
+            return;
+        }
+        co2 &before = cells[((std::size_t) x * height + y) * depth + z];
+        remove(before);
+        before = state;
+        add(before);
+    }
+
+    /*
+     * No row for the skipped times: the next one is the first multiple of the interval at or after the jump
+     */
+    void skip(double from, double to) override {
+        start();
+        report_before(from);
+        reports = std::max(reports, (long) std::ceil(to / interval));
+        next_report = reports * interval;
+    }
+
+    void finish(double time) override {
+        start();
+        report_before(time);
+        if (out != nullptr) {
+            out->flush();
+        }
+    }
+
+    /*
+     * Mean concentration of the air cells
+     */
+    [[nodiscard]] double mean() const {
+        return (air_cells > 0)? (double) concentration_sum / air_cells : 0;
+    }
+
+    /*
+     * Maximum concentration of the air cells
+     */
+    [[nodiscard]] int max() const {
+        return concentrations.empty()? 0 : concentrations.rbegin()->first;
+    }
+
+    [[nodiscard]] long occupied() const {
+        return occupied_cells;
+    }
+
+    [[nodiscard]] long above_threshold() const {
+        return high_cells;
+    }
+
+    // Highest values of the reported rows
+    double peak_mean = 0;
+    int peak_max = 0;
+    long peak_occupied = 0;
+    long peak_above_threshold = 0;
+
+private:
+    static bool is_air(co2 const &state) {
+        return state.type == AIR || state.type == CO2_SOURCE;
+    }
+
+    void start() {
+        if (started) {
+            return;
+        }
+        started = true;
+        cells.assign((std::size_t) width * height * depth, co2(-1, 0, IMPERMEABLE_STRUCTURE));
+        for (auto const &cell : initial) {
+            cells[((std::size_t) cell.first[0] * height + cell.first[1]) * depth + cell.first[2]] = cell.second;
+        }
+        initial.clear();
+        for (co2 const &state : cells) {
+            add(state);
+        }
+    }
+
+    void add(co2 const &state) {
+        if (!is_air(state)) {
+            return;
+        }
+        air_cells++;
+        concentration_sum += state.concentration;
+        concentrations[state.concentration]++;
+        occupied_cells += (state.type == CO2_SOURCE)? 1 : 0;
+        high_cells += (state.concentration > threshold)? 1 : 0;
+    }
+
+    void remove(co2 const &state) {
+        if (!is_air(state)) {
+            return;
+        }
+        air_cells--;
+        concentration_sum -= state.concentration;
+        auto it = concentrations.find(state.concentration);
+        if (--it->second == 0) {
+            concentrations.erase(it);
+        }
+        occupied_cells -= (state.type == CO2_SOURCE)? 1 : 0;
+        high_cells -= (state.concentration > threshold)? 1 : 0;
+    }
+
+    /*
+     * Write the rows of the reporting times before the given time
+     */
+    void report_before(double time) {
+        while (next_report < time) {
+            if (out != nullptr) {
+                *out << next_report << "," << mean() << "," << max() << "," << occupied_cells << "," << high_cells << "\n";
+            }
+            peak_mean = std::max(peak_mean, mean());
+            peak_max = std::max(peak_max, max());
+            peak_occupied = std::max(peak_occupied, occupied_cells);
+            peak_above_threshold = std::max(peak_above_threshold, high_cells);
+            reports++;
+            next_report = reports * interval;
+        }
+    }
+
+    std::ofstream file;
+    std::ostream *out = nullptr; //Where the rows are written, nullptr for none
+    double interval;
+    int threshold;
+    int width = 0;
+    int height = 0;
+    int depth = 1;
+    std::vector<std::pair<std::array<int,3>, co2>> initial;
+    bool started = false;
+    std::vector<co2> cells; //Current state of every cell (index (x * height + y) * depth + z)
+    long air_cells = 0;
+    long long concentration_sum = 0;
+    std::map<int, long> concentrations; //Number of air cells at each concentration
+    long occupied_cells = 0;
+    long high_cells = 0;
+    long reports = 0;
+    double next_report = 0;
+};
+
+#endif //CADMIUM_CELLDEVS_CO2_METRICS_HPP
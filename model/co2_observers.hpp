@@ -0,0 +1,195 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CADMIUM_CELLDEVS_CO2_OBSERVERS_HPP
+#define CADMIUM_CELLDEVS_CO2_OBSERVERS_HPP
+
+#include <array>
+#include <ostream>
+#include <utility>
+#include <vector>
+#include "co2_state.hpp"
+
+/*
+ * Receives the state changes of the cells while the simulation runs.
+ * The engines first report the size of the lattice with shape (depth 1 for 2D scenarios, whose cells have z = 0),
+ * then every cell once with initial_state before the simulation starts,
+ * then every state change in non-decreasing time order, and call finish at the end.
+ * A run restored from a checkpoint calls resume with the time of the checkpoint first;
+ * the initial states that follow are then the states of the checkpoint.
+ * An engine that jumps over time steps (the fast-forward of the stencil engine) calls skip(from, to): the states at
+ * the times [from, to) are not known, and the states reached by the jump are notified as changes at time to.
+ */
+class co2_observer {
+public:
+    virtual ~co2_observer() = default;
+
+    virtual void shape(int /*width*/, int /*height*/, int /*depth*/) {}
+
+    virtual void resume(double /*time*/) {}
+
+    virtual void initial_state(int /*x*/, int /*y*/, int /*z*/, co2 const &/*state*/) {}
+
+    virtual void state_change(double /*time*/, int /*x*/, int /*y*/, int /*z*/, co2 const &/*state*/) {}
+
+    virtual void skip(double /*from*/, double /*to*/) {}
+
+    virtual void finish(double /*time*/) {}
+};
+
+/*
+ * Forwards the notifications to a list of observers
+ */
+class co2_observers : public co2_observer {
+public:
+    void add(co2_observer *observer) {
+        observers.push_back(observer);
+    }
+
+    [[nodiscard]] bool empty() const {
+        return observers.empty();
+    }
+
+    void shape(int width, int height, int depth) override {
+        for (auto observer : observers) {
+            observer->shape(width, height, depth);
+        }
+    }
+
+    void resume(double time) override {
+        for (auto observer : observers) {
+            observer->resume(time);
+        }
+    }
+
+    void initial_state(int x, int y, int z, co2 const &state) override {
+        for (auto observer : observers) {
+            observer->initial_state(x, y, z, state);
+        }
+    }
+
+    void state_change(double time, int x, int y, int z, co2 const &state) override {
+        for (auto observer : observers) {
+            observer->state_change(time, x, y, z, state);
+        }
+    }
+
+    void skip(double from, double to) override {
+        for (auto observer : observers) {
+            observer->skip(from, to);
+        }
+    }
+
+    void finish(double time) override {
+        for (auto observer : observers) {
+            observer->finish(time);
+        }
+    }
+
+private:
+    std::vector<co2_observer *> observers;
+};
+
+/*
+ * Writes the states in the text format of results/state.txt: the time, then one line per state.
+ * The initial states are written at time 0, before the first state change.
+ * A resumed run only writes the changes after the checkpoint, so its log continues the log of the original run.
+ */
+class text_state_log : public co2_observer {
+public:
+    explicit text_state_log(std::ostream &out) : out(out) {}
+
+    void shape(int /*width*/, int /*height*/, int depth) override {
+        three_d = depth > 1;
+    }
+
+    void resume(double /*time*/) override {
+        initial_written = true;
+    }
+
+    void initial_state(int x, int y, int z, co2 const &state) override {
+        if (!initial_written) {
+            initial.push_back({{x, y, z}, state});
+        }
+    }
+
+    void state_change(double time, int x, int y, int z, co2 const &state) override {
+        write_initial();
+        if (!has_time || time != last_time) {
+            out << time << "\n";
+            has_time = true;
+            last_time = time;
+        }
+        write(x, y, z, state);
+    }
+
+    void finish(double /*time*/) override {
+        write_initial();
+        out.flush();
+    }
+
+    /*
+     * One state line, e.g. "State for model (1,2) is <-1,500,-100>", or "(1,2,0)" in 3D scenarios
+     */
+    static void write(std::ostream &out, int x, int y, int z, bool three_d, co2 const &state) {
+        out << "State for model (" << x << "," << y;
+        if (three_d) {
+            out << "," << z;
+        }
+        out << ") is " << state << "\n";
+    }
+
+private:
+    void write(int x, int y, int z, co2 const &state) {
+        write(out, x, y, z, three_d, state);
+    }
+
+    void write_initial() {
+        if (initial_written) {
+            return;
+        }
+        initial_written = true;
+        if (initial.empty()) {
+            return;
+        }
+        out << 0 << "\n";
+        has_time = true;
+        last_time = 0;
+        for (auto const &cell : initial) {
+            write(cell.first[0], cell.first[1], cell.first[2], cell.second);
+        }
+        initial.clear();
+    }
+
+    std::ostream &out;
+    std::vector<std::pair<std::array<int,3>, co2>> initial;
+    bool three_d = false;
+    bool initial_written = false;
+    bool has_time = false;
+    double last_time = 0;
+};
+
+#endif //CADMIUM_CELLDEVS_CO2_OBSERVERS_HPP
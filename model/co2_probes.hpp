@@ -0,0 +1,240 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CADMIUM_CELLDEVS_CO2_PROBES_HPP
+#define CADMIUM_CELLDEVS_CO2_PROBES_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "co2_observers.hpp"
+
+using nlohmann::json;
+
+/*
+ * Virtual CO2 sensors, read from the "probes" entry of the scenario block:
+ *   "probes": {
+ *       "interval": 10,
+ *       "sensors": [{"name": "till", "cell": [20, 21]}, {"name": "aisles", "region": [[1, 1], [22, 9]]}]
+ *   }
+ * A sensor reads one cell, or the mean of a box of cells given by two opposite corners (both included).
+ * The solid cells of a region do not count. The cells are [x, y] or [x, y, z] in 3D scenarios.
+ */
+struct probe_set {
+    struct sensor {
+        std::string name;
+        std::array<int,3> from; //Lowest corner of the cells read
+        std::array<int,3> to; //Highest corner of the cells read
+    };
+
+    double interval = 0; //Time between two readings
+    std::vector<sensor> sensors;
+
+    static probe_set from_json(json const &j) {
+        probe_set res;
+        res.interval = j.at("interval").get<double>();
+        if (res.interval <= 0) {
+            throw std::invalid_argument("the probe interval must be positive");
+        }
+        for (auto const &s : j.at("sensors")) {
+            sensor probe;
+            probe.name = s.at("name").get<std::string>();
+            if (s.contains("cell")) {
+                probe.from = probe.to = corner(s.at("cell"));
+            } else {
+                auto const &region = s.at("region");
+                if (region.size() != 2) {
+                    throw std::invalid_argument("the region of probe " + probe.name + " must have two corners");
+                }
+                auto a = corner(region[0]);
+                auto b = corner(region[1]);
+                for (int i = 0; i < 3; i++) {
+                    probe.from[i] = std::min(a[i], b[i]);
+                    probe.to[i] = std::max(a[i], b[i]);
+                }
+            }
+            res.sensors.push_back(probe);
+        }
+        if (res.sensors.empty()) {
+            throw std::invalid_argument("the probes have no sensor");
+        }
+        return res;
+    }
+
+private:
+    static std::array<int,3> corner(json const &cell) {
+        auto position = cell.get<std::vector<int>>();
+        if (position.size() != 2 && position.size() != 3) {
+            throw std::invalid_argument("probe cells must be [x, y] or [x, y, z]");
+        }
+        return {position[0], position[1], (position.size() == 3)? position[2] : 0};
+    }
+};
+
+/*
+ * Writes the readings of the probes to a CSV file, instead of the states of the whole grid:
+ *   time,<name of sensor 1>,<name of sensor 2>...
+ * One row is written for every multiple of the interval, with the state after all the changes up to that time
+ * (as co2_metrics), and no row for the times skipped by a fast-forward. Only the cells of the sensors are kept, with
+ * the sum of every sensor, so the other state changes cost one hash lookup. A sensor without any cell that is not
+ * solid has an empty reading.
+ */
+class co2_probe_log : public co2_observer {
+public:
+    co2_probe_log(std::string const &file_path, probe_set probes) : probes(std::move(probes)) {
+        file.open(file_path);
+        if (!file) {
+            throw std::runtime_error("cannot open " + file_path);
+        }
+        file << "time";
+        for (auto const &sensor : this->probes.sensors) {
+            file << "," << sensor.name;
+        }
+        file << "\n";
+        sums.assign(this->probes.sensors.size(), 0);
+        counts.assign(this->probes.sensors.size(), 0);
+    }
+
+    /*
+     * A resumed run reads from the first multiple of the interval at or after the checkpoint
+     */
+    void resume(double time) override {
+        readings = (long) std::ceil(time / probes.interval);
+        next_reading = readings * probes.interval;
+    }
+
+    void shape(int width, int height, int depth) override {
+        this->width = width;
+        this->height = height;
+        this->depth = depth;
+        watched.clear();
+        for (std::size_t i = 0; i < probes.sensors.size(); i++) {
+            auto const &sensor = probes.sensors[i];
+            if (sensor.from[0] < 0 || sensor.from[1] < 0 || sensor.from[2] < 0 ||
+                sensor.to[0] >= width || sensor.to[1] >= height || sensor.to[2] >= depth) {
+                throw std::out_of_range("probe " + sensor.name + " out of the scenario shape");
+            }
+            for (int x = sensor.from[0]; x <= sensor.to[0]; x++) {
+                for (int y = sensor.from[1]; y <= sensor.to[1]; y++) {
+                    for (int z = sensor.from[2]; z <= sensor.to[2]; z++) {
+                        watched[index(x, y, z)].sensors.push_back((int) i);
+                    }
+                }
+            }
+        }
+    }
+
+    void initial_state(int x, int y, int z, co2 const &state) override {
+        update(x, y, z, state);
+    }
+
+    void state_change(double time, int x, int y, int z, co2 const &state) override {
+        read_before(time);
+        update(x, y, z, state);
+    }
+
+    void skip(double from, double to) override {
+        read_before(from);
+        readings = std::max(readings, (long) std::ceil(to / probes.interval));
+        next_reading = readings * probes.interval;
+    }
+
+    void finish(double time) override {
+        read_before(time);
+        file.flush();
+    }
+
+private:
+    struct watched_cell {
+        co2 state = co2(-1, 0, IMPERMEABLE_STRUCTURE);
+        std::vector<int> sensors; //Sensors that read the cell
+    };
+
+    [[nodiscard]] std::size_t index(int x, int y, int z) const {
+        return ((std::size_t) x * height + y) * depth + z;
+    }
+
+    void update(int x, int y, int z, co2 const &state) {
+        if (x < 0 || y < 0 || z < 0 || x >= width || y >= height || z >= depth) {
+            return;
+        }
+        auto it = watched.find(index(x, y, z));
+        if (it == watched.end()) {
+            return;
+        }
+        co2 &before = it->second.state;
+        for (int sensor : it->second.sensors) {
+            if (before.type != IMPERMEABLE_STRUCTURE) {
+                sums[sensor] -= before.concentration;
+                counts[sensor]--;
+            }
+            if (state.type != IMPERMEABLE_STRUCTURE) {
+                sums[sensor] += state.concentration;
+                counts[sensor]++;
+            }
+        }
+        before = state;
+    }
+
+    /*
+     * Write the rows of the reading times before the given time
+     */
+    void read_before(double time) {
+        while (next_reading < time) {
+            file << next_reading;
+            for (std::size_t i = 0; i < sums.size(); i++) {
+                file << ",";
+                if (counts[i] > 0) {
+                    file << (double) sums[i] / counts[i];
+                }
+            }
+            file << "\n";
+            readings++;
+            next_reading = readings * probes.interval;
+        }
+    }
+
+    std::ofstream file;
+    probe_set probes;
+    int width = 0;
+    int height = 0;
+    int depth = 1;
+    std::unordered_map<std::size_t, watched_cell> watched; //Cells read by the sensors (index (x * height + y) * depth + z)
+    std::vector<long long> sums; //Concentration of the cells of every sensor that are not solid
+    std::vector<long> counts; //Cells of every sensor that are not solid
+    long readings = 0;
+    double next_reading = 0;
+};
+
+#endif //CADMIUM_CELLDEVS_CO2_PROBES_HPP
@@ -0,0 +1,119 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CADMIUM_CELLDEVS_CO2_PROFILE_HPP
+#define CADMIUM_CELLDEVS_CO2_PROFILE_HPP
+
+/*
+ * Hot-path instrumentation, compiled in only with CO2_PROFILING (cmake -DCO2_PROFILING=ON).
+ * Without it the CO2_PROFILE_* macros expand to nothing and the model has no profiling code at all.
+ *
+ * CO2_PROFILE_CELL(type)  counts a local computation of a cell of the given CELL_TYPE
+ * CO2_PROFILE_COUNT(name) counts an event (move_checks, blocked_moves, spawns, exits, messages)
+ * CO2_PROFILE_TIME(name)  adds the time until the end of the enclosing block to a timer
+ *                         (diffusion, movement, navigation, routes)
+ * The counters are relaxed atomics, so the threads of the stencil engine can update them; the timers of code run by
+ * several threads add up their times.
+ */
+#ifdef CO2_PROFILING
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include "co2_state.hpp"
+
+struct co2_profile {
+    struct timer {
+        std::atomic<long long> nanoseconds{0};
+        std::atomic<long> calls{0};
+    };
+
+    std::atomic<long> computations[9] = {}; //Local computations per CELL_TYPE, see type_index
+    std::atomic<long> move_checks{0}; //moveCheck calls (counted only: they are too short to read the clock twice)
+    std::atomic<long> blocked_moves{0}; //Shoppers that could not move closer to their goal
+    std::atomic<long> spawns{0}; //Shoppers that entered the store
+    std::atomic<long> exits{0}; //Shoppers that left the store
+    std::atomic<long> messages{0}; //New states sent through the output port of the cells
+    timer diffusion; //Local rule of the cells (neighbourhood average and concentration update)
+    timer movement; //Whole movement phase of the shoppers
+    timer navigation; //Update of the distance fields
+    timer routes; //setNextRoute of every shopper
+
+    static int type_index(CELL_TYPE type) {
+        return -type / 100 - 1;
+    }
+
+    void write_json(std::string const &file_path) const {
+        static const char *type_names[9] = {"AIR", "CO2_SOURCE", "IMPERMEABLE_STRUCTURE", "DOOR", "WINDOW",
+                                            "VENTILATION", "DAILYUSE", "FOODS", "DRINKS"};
+        json j;
+        for (int i = 0; i < 9; i++) {
+            j["local_computations"][type_names[i]] = computations[i].load();
+        }
+        j["shoppers"] = {{"move_checks", move_checks.load()}, {"blocked_moves", blocked_moves.load()},
+                         {"spawns", spawns.load()}, {"exits", exits.load()}};
+        j["messages"] = {{"output", messages.load()}};
+        auto seconds = [](timer const &t) {
+            return json{{"seconds", t.nanoseconds.load() * 1e-9}, {"calls", t.calls.load()}};
+        };
+        j["timers"] = {{"diffusion", seconds(diffusion)}, {"movement", seconds(movement)}, {"navigation", seconds(navigation)},
+                       {"routes", seconds(routes)}};
+        std::ofstream(file_path) << j.dump(4) << std::endl;
+    }
+};
+
+co2_profile profile; //Profile of the run
+
+// Adds the lifetime of the object to a timer
+class profile_timer {
+public:
+    explicit profile_timer(co2_profile::timer &t) : t(t), start(std::chrono::steady_clock::now()) {}
+
+    ~profile_timer() {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        t.nanoseconds.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(), std::memory_order_relaxed);
+        t.calls.fetch_add(1, std::memory_order_relaxed);
+    }
+
+private:
+    co2_profile::timer &t;
+    std::chrono::steady_clock::time_point start;
+};
+
+#define CO2_PROFILE_CELL(type) profile.computations[co2_profile::type_index(type)].fetch_add(1, std::memory_order_relaxed)
+#define CO2_PROFILE_COUNT(name) profile.name.fetch_add(1, std::memory_order_relaxed)
+#define CO2_PROFILE_TIME(name) profile_timer profile_timer_##name(profile.name)
+
+#else
+
+#define CO2_PROFILE_CELL(type)
+#define CO2_PROFILE_COUNT(name)
+#define CO2_PROFILE_TIME(name)
+
+#endif
+
+#endif //CADMIUM_CELLDEVS_CO2_PROFILE_HPP
@@ -0,0 +1,139 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CADMIUM_CELLDEVS_CO2_RULE_HPP
+#define CADMIUM_CELLDEVS_CO2_RULE_HPP
+
+#include <cassert>
+#include <cstdlib>
+#include "co2_state.hpp"
+
+float cell_size = 25;
+
+/*
+ * Local rule of the CO2 cells, shared by the Cadmium cells and the stencil engine.
+ * The neighbourhood average is computed by the caller; the rule only decides the next state.
+ */
+class co2_rule {
+public:
+    float concentration_increase; //// CO2 sources have their concentration continually increased
+    int base; //CO2 base level
+    int resp_time; //Time used to calculate the concentration inscrease
+    int window_conc; //CO2 level at window
+    int vent_conc; //CO2 level at cent
+    int quantum; //Minimum concentration change that is propagated
+
+    co2_rule() : co2_rule(conc()) {}
+
+    explicit co2_rule(conc const &config) {
+        float volume = cell_size*cell_size*cell_size;
+        concentration_increase = (19*100000)/volume;
+        base = config.base;
+        resp_time = config.resp_time;
+        window_conc = config.window_conc;
+        vent_conc = config.vent_conc;
+        quantum = config.quantum;
+    }
+
+    static bool is_static(CELL_TYPE type) {
+        return type == IMPERMEABLE_STRUCTURE || type == DOOR || type == WINDOW || type == VENTILATION;
+    }
+
+    /*
+     * return the constant concentration of a static cell
+     */
+    [[nodiscard]] int static_concentration(CELL_TYPE type) const {
+        switch(type){
+            case DOOR: return base;
+            case WINDOW: return window_conc;
+            case VENTILATION: return vent_conc;
+            default: return 0;
+        }
+    }
+
+    /*
+     * Calculate the next state of a cell
+     *
+     * average: mean concentration of the permeable neighbours (the cell included)
+     * occupied: true if a shopper stands on the cell
+     * return: the next state
+     */
+    [[nodiscard]] co2 next_state(co2 const &current, int average, bool occupied) const {
+        co2 new_state = current;
+        switch(current.type){
+            case IMPERMEABLE_STRUCTURE:
+            case DOOR:
+            case WINDOW:
+            case VENTILATION:
+                new_state.concentration = static_concentration(current.type);
+                break;
+            case AIR:
+                new_state.concentration = average;
+                //Appear CO2_Source at currentLocation
+                if(occupied){
+                    new_state.type = CO2_SOURCE;
+                }
+                break;
+            case DAILYUSE:
+            case FOODS:
+            case DRINKS:
+                new_state.concentration = average;
+                break;
+            case CO2_SOURCE:
+                new_state.concentration = average + concentration_increase;
+                new_state.counter += 1;
+                //Remove CO2_Source at currentLocation
+                if(!occupied){
+                    new_state.type = AIR;
+                }
+                break;
+            default:{
+                assert(false && "should never happen");
+            }
+        }
+        return new_state;
+    }
+
+    /*
+     * Quantized state: small concentration changes are not propagated
+     *
+     * return true if the new state must be discarded
+     */
+    [[nodiscard]] bool below_quantum(co2 const &current, co2 const &new_state) const {
+        return new_state.type == current.type && new_state.counter == current.counter &&
+               std::abs(new_state.concentration - current.concentration) < quantum;
+    }
+
+    // It returns the delay to communicate cell's new state.
+    [[nodiscard]] int output_delay(CELL_TYPE type) const {
+        switch(type){
+            case CO2_SOURCE: return resp_time;
+            default: return 1;
+        }
+    }
+};
+
+#endif //CADMIUM_CELLDEVS_CO2_RULE_HPP
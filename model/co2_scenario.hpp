@@ -0,0 +1,429 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CADMIUM_CELLDEVS_CO2_SCENARIO_HPP
+#define CADMIUM_CELLDEVS_CO2_SCENARIO_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "arrival_process.hpp"
+#include "co2_probes.hpp"
+#include "co2_state.hpp"
+
+/*
+ * Dense copy of a 2D or 3D scenario: the initial state of every cell and the CO2_cell configuration.
+ * 2D scenarios have depth 1; the cells of 3D scenarios are (x, y, z), where z = 0 is the floor of the store.
+ * It is used by the engines that do not build the Cadmium lattice, and to convert between the scenario formats.
+ * A JSON scenario can also be read as a sparse copy (load_json with sparse = true): only the cells listed in the file
+ * are kept, the others are at the default state, so its memory does not follow the bounding box of the store.
+ * When the file lists most of the cells, the dense copy is smaller and it is made instead.
+ *
+ * Besides the JSON format of add_lattice_json, scenarios can be written as a raster layout (.map):
+ *   {"scenario": {...}, "legend": {".": {"counter": -1, "concentration": 500, "type": -100}, ...}}
+ *   map
+ *   ##########
+ *   #....u...D
+ *   ...
+ * The header is the "scenario" block of the JSON format and a legend from one character to a cell state.
+ * After the "map" line, line x of the raster holds the cells (x, 0) to (x, height - 1), one character per cell.
+ * The raster format is only for 2D scenarios.
+ */
+struct co2_scenario {
+    // Cell listed in a JSON scenario: its id (x, y, z), with z = 0 in 2D scenarios, and its state
+    struct listed_cell {
+        std::array<int, 3> cell_id;
+        co2 state;
+    };
+
+    int width = 0;
+    int height = 0;
+    int depth = 1;
+    conc config;
+    std::vector<co2> cells; //Initial state of every cell, indexed by (x * height + y) * depth + z (dense copies)
+    bool sparse = false; //Sparse copy: cells is empty, the states are in listed and default_state
+    std::vector<listed_cell> listed; //Sparse copies: the cells of the file with a state, by id, without duplicates
+    co2 default_state; //State of the cells missing from the file
+    json scenario; //The "scenario" block of the file (shape, default state and config, neighborhood...)
+    std::optional<uint64_t> seed; //Seed of the random numbers ("seed" in the scenario block), if any
+    std::optional<arrival_process> arrivals; //Shopper arrivals ("arrivals" in the scenario block), if any
+    std::optional<probe_set> probes; //Virtual sensors ("probes" in the scenario block), if any
+
+    [[nodiscard]] co2 const &at(int x, int y, int z = 0) const {
+        if (!sparse) {
+            return cells[((std::size_t) x * height + y) * depth + z];
+        }
+        std::array<int, 3> cell_id{x, y, z};
+        auto it = std::lower_bound(listed.begin(), listed.end(), cell_id,
+                                   [](listed_cell const &cell, std::array<int, 3> const &id) { return cell.cell_id < id; });
+        return (it != listed.end() && it->cell_id == cell_id)? it->state : default_state;
+    }
+
+    /*
+     * Cell of a dense copy, to edit it. Sparse copies are read through a const reference.
+     */
+    co2 &at(int x, int y, int z = 0) {
+        if (sparse) {
+            throw std::logic_error("the cells of a sparse scenario cannot be edited");
+        }
+        return cells[((std::size_t) x * height + y) * depth + z];
+    }
+
+    /*
+     * Read a scenario in the JSON format of add_lattice_json or in the raster format (files ending in .map).
+     * Only non-wrapped lattices with a von Neumann neighbourhood of range 1 are supported.
+     * sparse: read a JSON scenario as a sparse copy if it is smaller (raster layouts list every cell, they are always dense)
+     */
+    static co2_scenario from_file(std::string const &file_path, bool sparse = false) {
+        return is_raster(file_path)? from_raster_file(file_path) : from_json_file(file_path, sparse);
+    }
+
+    static co2_scenario from_json_file(std::string const &file_path, bool sparse = false) {
+        co2_scenario res = load_json(file_path, sparse);
+        res.check_supported();
+        return res;
+    }
+
+    static co2_scenario from_raster_file(std::string const &file_path) {
+        co2_scenario res = load_raster(file_path);
+        res.check_supported();
+        return res;
+    }
+
+    static bool is_raster(std::string const &file_path) {
+        return file_path.size() >= 4 && file_path.compare(file_path.size() - 4, 4, ".map") == 0;
+    }
+
+    /*
+     * Read a scenario in the JSON format without checking if the stencil engine supports it.
+     * The cells are converted while the file is parsed and dropped from the JSON document, so the document of a
+     * large lattice is never held in memory as a whole (the "cells" block usually comes before the "scenario" block).
+     * Only the cells with a state are kept, and their ids are checked against the shape once it is known.
+     * sparse: keep them instead of spreading them over a dense array, unless the dense array is smaller
+     */
+    static co2_scenario load_json(std::string const &file_path, bool sparse = false) {
+        std::ifstream i(file_path);
+        if (!i) {
+            throw std::runtime_error("cannot open scenario " + file_path);
+        }
+        std::vector<listed_cell> parsed_cells;
+        id_range ids;
+        bool in_cells = false;
+        json j = json::parse(i, [&](int depth, json::parse_event_t event, json &parsed) {
+            if (depth == 1 && event == json::parse_event_t::key) {
+                in_cells = parsed == "cells";
+            } else if (in_cells && depth == 2 && event == json::parse_event_t::object_end) {
+                parsed_cell cell = parse_cell(parsed);
+                ids.add(cell);
+                if (cell.has_state) {
+                    parsed_cells.push_back({cell.cell_id, cell.state});
+                }
+                return false;
+            }
+            return true;
+        });
+
+        co2_scenario res = with_header(j.at("scenario"), true);
+        if (!ids.fits(res.width, res.height, res.depth)) {
+            throw std::out_of_range("cell out of the scenario shape");
+        }
+        //A sparse copy is only kept if it is smaller than the dense one
+        auto volume = (std::size_t) res.width * res.height * res.depth;
+        if (!sparse || parsed_cells.size() * sizeof(listed_cell) >= volume * sizeof(co2)) {
+            res.sparse = false;
+            res.cells.assign(volume, res.default_state);
+            for (listed_cell const &cell : parsed_cells) {
+                res.at(cell.cell_id[0], cell.cell_id[1], cell.cell_id[2]) = cell.state;
+            }
+            return res;
+        }
+        //The ids sort like the cell indexes. A cell listed twice takes its last state, as in the dense copies.
+        //The files written by to_json are already sorted, and then no sort buffer is allocated.
+        auto by_id = [](listed_cell const &a, listed_cell const &b) { return a.cell_id < b.cell_id; };
+        if (!std::is_sorted(parsed_cells.begin(), parsed_cells.end(), by_id)) {
+            std::stable_sort(parsed_cells.begin(), parsed_cells.end(), by_id);
+        }
+        std::size_t n = 0;
+        for (std::size_t k = 0; k < parsed_cells.size(); k++) {
+            if (k + 1 == parsed_cells.size() || parsed_cells[k + 1].cell_id != parsed_cells[k].cell_id) {
+                parsed_cells[n++] = parsed_cells[k];
+            }
+        }
+        parsed_cells.resize(n);
+        res.listed = std::move(parsed_cells);
+        return res;
+    }
+
+    /*
+     * Read a raster scenario without checking if the stencil engine supports it.
+     * Only the header goes through the JSON parser; the raster is read line by line into the cells.
+     */
+    static co2_scenario load_raster(std::string const &file_path) {
+        std::ifstream in(file_path);
+        if (!in) {
+            throw std::runtime_error("cannot open scenario " + file_path);
+        }
+        std::string header;
+        std::string line;
+        bool has_map = false;
+        while (std::getline(in, line)) {
+            trim(line);
+            if (line == "map") {
+                has_map = true;
+                break;
+            }
+            header += line;
+            header += '\n';
+        }
+        if (!has_map) {
+            throw std::invalid_argument(file_path + " has no map section");
+        }
+        json j = json::parse(header);
+
+        co2_scenario res = with_header(j.at("scenario"), false);
+        if (res.depth > 1) {
+            throw std::invalid_argument("raster layouts are only for 2D scenarios");
+        }
+        co2 symbols[256];
+        bool known[256] = {};
+        for (auto const &entry : j.at("legend").items()) {
+            if (entry.key().size() != 1) {
+                throw std::invalid_argument("legend symbols must be one character: " + entry.key());
+            }
+            auto symbol = (unsigned char) entry.key()[0];
+            symbols[symbol] = entry.value().get<co2>();
+            known[symbol] = true;
+        }
+
+        for (int x = 0; x < res.width; x++) {
+            if (!std::getline(in, line)) {
+                throw std::invalid_argument("the map has less than " + std::to_string(res.width) + " lines");
+            }
+            trim(line);
+            if ((int) line.size() != res.height) {
+                throw std::invalid_argument("line " + std::to_string(x) + " of the map does not have " +
+                                            std::to_string(res.height) + " cells");
+            }
+            co2 *row = &res.at(x, 0);
+            for (int y = 0; y < res.height; y++) {
+                auto symbol = (unsigned char) line[y];
+                if (!known[symbol]) {
+                    throw std::invalid_argument(std::string("symbol not in the legend: ") + line[y]);
+                }
+                row[y] = symbols[symbol];
+            }
+        }
+        return res;
+    }
+
+    /*
+     * return: the scenario in the JSON format of add_lattice_json (only the cells that differ from the default state)
+     */
+    [[nodiscard]] json to_json() const {
+        co2 default_state = scenario.at("default_state").get<co2>();
+        json j_cells = json::array();
+        for (int x = 0; x < width; x++) {
+            for (int y = 0; y < height; y++) {
+                for (int z = 0; z < depth; z++) {
+                    if (at(x, y, z) != default_state) {
+                        json cell_id = (depth > 1)? json{x, y, z} : json{x, y};
+                        j_cells.push_back({{"cell_id", cell_id}, {"state", at(x, y, z)}});
+                    }
+                }
+            }
+        }
+        return {{"scenario", scenario}, {"cells", j_cells}};
+    }
+
+    /*
+     * Write the scenario in the raster format. Every distinct state gets a symbol, chosen after its cell type.
+     */
+    void write_raster(std::ostream &out) const {
+        if (depth > 1) {
+            throw std::invalid_argument("raster layouts are only for 2D scenarios");
+        }
+        std::vector<co2> legend;
+        std::vector<char> symbols;
+        std::string used;
+        std::string spare = "0123456789ABCEGHIJLMNOPQRTXYZabceghijklmnopqrtvwxyz+*=%&@$!?~^";
+        auto symbol_of = [&](co2 const &state) {
+            for (std::size_t i = 0; i < legend.size(); i++) {
+                if (!(legend[i] != state)) {
+                    return symbols[i];
+                }
+            }
+            char symbol = type_symbol(state.type);
+            if (symbol == 0 || used.find(symbol) != std::string::npos) {
+                auto free = spare.find_first_not_of(used);
+                if (free == std::string::npos) {
+                    throw std::length_error("too many distinct cell states for the raster format");
+                }
+                symbol = spare[free];
+            }
+            legend.push_back(state);
+            symbols.push_back(symbol);
+            used.push_back(symbol);
+            return symbol;
+        };
+
+        std::vector<std::string> rows(width, std::string(height, ' '));
+        for (int x = 0; x < width; x++) {
+            for (int y = 0; y < height; y++) {
+                rows[x][y] = symbol_of(at(x, y));
+            }
+        }
+        json j_legend = json::object();
+        for (std::size_t i = 0; i < legend.size(); i++) {
+            j_legend[std::string(1, symbols[i])] = legend[i];
+        }
+        out << json{{"scenario", scenario}, {"legend", j_legend}}.dump(4) << std::endl;
+        out << "map" << std::endl;
+        for (auto const &row : rows) {
+            out << row << '\n';
+        }
+        out.flush();
+    }
+
+private:
+    // Cell of the "cells" block of a JSON scenario
+    struct parsed_cell {
+        std::array<int, 3> cell_id;
+        int dimensions;
+        bool has_state;
+        co2 state;
+    };
+
+    // Bounds of the ids of the cells of a JSON scenario, read before the "scenario" block that holds its shape
+    struct id_range {
+        bool any = false;
+        bool mixed = false; //Cells with different dimensions
+        int dimensions = 0;
+        std::array<int, 3> lowest{0, 0, 0};
+        std::array<int, 3> highest{0, 0, 0};
+
+        void add(parsed_cell const &cell) {
+            if (!any) {
+                any = true;
+                dimensions = cell.dimensions;
+                lowest = highest = cell.cell_id;
+            }
+            mixed = mixed || cell.dimensions != dimensions;
+            for (int d = 0; d < 3; d++) {
+                lowest[d] = std::min(lowest[d], cell.cell_id[d]);
+                highest[d] = std::max(highest[d], cell.cell_id[d]);
+            }
+        }
+
+        [[nodiscard]] bool fits(int width, int height, int depth) const {
+            return !any || (!mixed && dimensions == (depth > 1? 3 : 2) && lowest[0] >= 0 && lowest[1] >= 0 &&
+                            lowest[2] >= 0 && highest[0] < width && highest[1] < height && highest[2] < depth);
+        }
+    };
+
+    static parsed_cell parse_cell(json const &cell) {
+        auto const &cell_id = cell.at("cell_id");
+        parsed_cell res{{0, 0, 0}, (int) cell_id.size(), cell.contains("state"), co2()};
+        if (res.dimensions > 3) {
+            res.dimensions = 0; //Rejected with the cells of the wrong dimension
+        }
+        for (int d = 0; d < res.dimensions; d++) {
+            res.cell_id[d] = cell_id[d].get<int>();
+        }
+        if (res.has_state) {
+            res.state = cell.at("state").get<co2>();
+        }
+        return res;
+    }
+
+    static co2_scenario with_header(json const &scenario, bool sparse) {
+        auto shape = scenario.at("shape").get<std::vector<int>>();
+        if (shape.size() != 2 && shape.size() != 3) {
+            throw std::invalid_argument("only 2D and 3D scenarios are supported");
+        }
+        co2_scenario res;
+        res.width = shape[0];
+        res.height = shape[1];
+        res.depth = (shape.size() == 3)? shape[2] : 1;
+        res.scenario = scenario;
+        res.config = scenario.at("default_config").at("CO2_cell").get<conc>();
+        res.default_state = scenario.at("default_state").get<co2>();
+        res.sparse = sparse;
+        if (!sparse) {
+            res.cells.assign((std::size_t) res.width * res.height * res.depth, res.default_state);
+        }
+        if (scenario.contains("seed")) {
+            res.seed = scenario.at("seed").get<uint64_t>();
+        }
+        if (scenario.contains("arrivals")) {
+            res.arrivals = arrival_process::from_json(scenario.at("arrivals"));
+        }
+        if (scenario.contains("probes")) {
+            res.probes = probe_set::from_json(scenario.at("probes"));
+        }
+        return res;
+    }
+
+    void check_supported() const {
+        if (scenario.contains("wrapped") && scenario.at("wrapped").get<bool>()) {
+            throw std::invalid_argument("wrapped scenarios are not supported");
+        }
+        for (auto const &n : scenario.at("neighborhood")) {
+            if (n.at("type").get<std::string>() != "von_neumann" || (n.contains("range") && n.at("range").get<int>() != 1)) {
+                throw std::invalid_argument("only von Neumann neighborhoods of range 1 are supported");
+            }
+        }
+    }
+
+    static char type_symbol(CELL_TYPE type) {
+        switch (type) {
+            case AIR: return '.';
+            case CO2_SOURCE: return 's';
+            case IMPERMEABLE_STRUCTURE: return '#';
+            case DOOR: return 'D';
+            case WINDOW: return 'W';
+            case VENTILATION: return 'V';
+            case DAILYUSE: return 'u';
+            case FOODS: return 'f';
+            case DRINKS: return 'd';
+            default: return 0;
+        }
+    }
+
+    static void trim(std::string &line) {
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' ' || line.back() == '\t')) {
+            line.pop_back();
+        }
+    }
+};
+
+#endif //CADMIUM_CELLDEVS_CO2_SCENARIO_HPP
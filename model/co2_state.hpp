@@ -0,0 +1,103 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/**
+* Model developed by Hoda Khalil in Cell-DEVS CD++
+* Implemented in Cadmium-cell-DEVS by Cristina Ruiz Martin
+*/
+
+#ifndef CADMIUM_CELLDEVS_CO2_STATE_HPP
+#define CADMIUM_CELLDEVS_CO2_STATE_HPP
+
+#include <ostream>
+#include <nlohmann/json.hpp>
+
+using nlohmann::json;
+
+/************************************/
+/******COMPLEX STATE STRUCTURE*******/
+/************************************/
+enum CELL_TYPE {AIR=-100, CO2_SOURCE=-200, IMPERMEABLE_STRUCTURE=-300, DOOR=-400, WINDOW=-500, VENTILATION=-600, DAILYUSE=-700, FOODS=-800, DRINKS=-900};
+struct co2 {
+    int counter;
+    int concentration;
+    CELL_TYPE type;
+    co2() : counter(-1), concentration(500), type(AIR) {}  // a default constructor is required
+    co2(int i_counter, int i_concentration, CELL_TYPE i_type) : counter(i_counter), concentration(i_concentration), type(i_type) {}
+};
+// Required for comparing states and detect any change
+inline bool operator != (const co2 &x, const co2 &y) {
+    return x.counter != y.counter || x.concentration != y.concentration || x.type != y.type;
+}
+// Required if you want to use transport delay (priority queue has to sort messages somehow)
+inline bool operator < (const co2& lhs, const co2& rhs){ return true; }
+
+// Required for printing the state of the cell
+std::ostream &operator << (std::ostream &os, const co2 &x) {
+    os << "<" << x.counter << "," << x.concentration << "," << x.type <<">";
+    return os;
+}
+
+// Required for creating co2 objects from JSON file
+void from_json(const json& j, co2 &s) {
+    j.at("counter").get_to(s.counter);
+    j.at("concentration").get_to(s.concentration);
+    j.at("type").get_to(s.type);
+}
+
+// Required for writing co2 objects to JSON files
+void to_json(json& j, const co2 &s) {
+    j = json{{"counter", s.counter}, {"concentration", s.concentration}, {"type", s.type}};
+}
+
+/************************************/
+/******COMPLEX CONFIG STRUCTURE******/
+/************************************/
+struct conc {
+    float conc_increase; //CO2 generated by one person
+    int base; //CO2 base level 500
+    int window_conc; //CO2 level at window 400
+    int vent_conc; //CO2 level at vent 300
+    int resp_time;
+    int totalStudents; //Total CO2_Source in the model
+    int quantum; //Minimum concentration change (ppm) that is propagated, 0 propagates every change
+    // Each cell is 25cm x 25cm x 25cm = 15.626 Liters of air each
+    // CO2 sources have their concentration continually increased by default by 12.16 ppm every 5 seconds.
+    conc(): conc_increase(121.6), base(500), resp_time(5), window_conc(400), vent_conc(300), totalStudents(25), quantum(0) {}
+    conc(float ci, int b, int wc, int vc, int r, int ts, int q=0): conc_increase(ci), base(b), resp_time(r), window_conc(wc), vent_conc(vc), totalStudents(ts), quantum(q) {}
+};
+void from_json(const json& j, conc &c) {
+    j.at("conc_increase").get_to(c.conc_increase);
+    j.at("base").get_to(c.base);
+    j.at("resp_time").get_to(c.resp_time);
+    j.at("window_conc").get_to(c.window_conc);
+    j.at("vent_conc").get_to(c.vent_conc);
+    j.at("totalStudents").get_to(c.totalStudents);
+    if (j.contains("quantum")) {
+        j.at("quantum").get_to(c.quantum);
+    }
+}
+
+#endif //CADMIUM_CELLDEVS_CO2_STATE_HPP
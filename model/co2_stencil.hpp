@@ -0,0 +1,1009 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CADMIUM_CELLDEVS_CO2_STENCIL_HPP
+#define CADMIUM_CELLDEVS_CO2_STENCIL_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "calendar_queue.hpp"
+#include "co2_checkpoint.hpp"
+#include "co2_observers.hpp"
+#include "co2_profile.hpp"
+#include "co2_rule.hpp"
+#include "co2_scenario.hpp"
+#include "shopper_engine.hpp"
+#include "thread_pool.hpp"
+
+/*
+ * Adaptive resolution of the stencil engine (see co2_stencil::set_adaptive)
+ */
+struct adaptive_options {
+    int block = 0; //Side of the coarse blocks in cells, 0 to simulate every cell
+    int threshold = 10; //Concentration difference (ppm) above which a block is not merged, or is split again
+    int interval = 10; //Time steps between two searches of blocks to merge
+};
+
+/*
+ * Synchronous execution of the CO2 model on flat arrays.
+ *
+ * It reproduces the Cadmium cells with transport delays: a cell publishes its new state output_delay time units
+ * after computing it, and a cell is only computed at the times one of its neighbours (or itself) publishes.
+ * Walls, doors, windows and vents keep a constant concentration, so once they hold it they are never computed.
+ * Times are integer ticks and the pending publications are kept in a calendar queue (see calendar_queue.hpp).
+ * The neighbourhood average of all the cells is a branch-free stencil over the published concentrations,
+ * with the impermeable cells masked out and the division replaced by a multiplication with a precomputed reciprocal.
+ *
+ * With more than one thread the lattice is split in tiles of whole columns that are computed in parallel.
+ * The published concentrations act as the halo of every tile: they are only written between time steps, when the
+ * publications are delivered. Shopper moves, publications and logging stay on the calling thread and are merged
+ * in tile order, so the results do not depend on the number of threads.
+ *
+ * In adaptive mode, quiescent blocks of the lattice are simulated as one coarse cell (see set_adaptive).
+ */
+class co2_stencil {
+public:
+    explicit co2_stencil(co2_scenario const &scenario, int threads = 1) : co2_stencil(scenario, scenario.config, threads) {}
+
+    /*
+     * Run the layout of the scenario with another CO2_cell configuration (e.g. one point of a parameter sweep)
+     */
+    co2_stencil(co2_scenario const &scenario, conc const &config, int threads) :
+            width(scenario.width), height(scenario.height), stride(scenario.height + 2), rule(config) {
+        if (scenario.depth > 1) {
+            throw std::invalid_argument("the stencil engine only runs 2D scenarios, use co2_volume for 3D scenarios");
+        }
+        if (scenario.sparse) {
+            throw std::invalid_argument("the stencil engine needs a dense scenario");
+        }
+        int padded = (width + 2) * stride;
+        current.assign(padded, co2(-1, 0, IMPERMEABLE_STRUCTURE));
+        visible.assign(padded, 0);
+        open.assign(padded, 0);
+        reciprocal.assign(padded, 0);
+        average.assign(padded, 0);
+        active.assign(padded, 0);
+        settled.assign(padded, 1);
+
+        int tiles = std::max(1, std::min(threads, width));
+        for (int t = 0; t <= tiles; t++) {
+            tile_bounds.push_back(t * width / tiles);
+        }
+        tile_changes.resize(tiles);
+        if (tiles > 1) {
+            pool = std::make_unique<thread_pool>(tiles);
+        }
+
+        //The columns of every tile are filled by the thread that computes them
+        for_each_tile([this, &scenario](int x0, int x1) {
+            for (int x = x0; x < x1; x++) {
+                for (int y = 0; y < height; y++) {
+                    co2 const &cell = scenario.at(x, y);
+                    current[index(x, y)] = cell;
+                    open[index(x, y)] = (cell.type != IMPERMEABLE_STRUCTURE)? 1 : 0;
+                    settle(index(x, y));
+                }
+            }
+        });
+        shoppers.total_shoppers = config.totalStudents;
+        shoppers.arrivals = scenario.arrivals;
+        shoppers.reserve(width, height);
+        for (int x = 0; x < width; x++) {
+            for (int y = 0; y < height; y++) {
+                shoppers.add_cell(x, y, scenario.at(x, y).type);
+            }
+        }
+        for_each_tile([this](int x0, int x1) {
+            for (int x = x0; x < x1; x++) {
+                for (int y = 0; y < height; y++) {
+                    int i = index(x, y);
+                    int n = open[i] + open[i - 1] + open[i + 1] + open[i - stride] + open[i + stride];
+                    reciprocal[i] = (n > 0)? ((uint64_t(1) << 32) + n - 1) / n : 0;
+                }
+            }
+        });
+
+        //Fingerprint of the layout, checked when a checkpoint is restored
+        for (co2 const &cell : scenario.cells) {
+            layout_hash = (layout_hash ^ (uint32_t) cell.type) * 1099511628211ULL;
+        }
+    }
+
+    /*
+     * Simulate the quiescent blocks of the lattice as coarse cells: every options.interval time steps, the aligned
+     * blocks of options.block x options.block cells that only hold air, shelves and walls, whose open cells are
+     * connected, within options.threshold ppm of each other and of their open neighbours, with no shopper closer than
+     * one block and no publication in flight, are merged into one coarse cell.
+     * A coarse cell only keeps the total concentration (mass) of its open cells, and all of them show its mean.
+     * Its inner cells are never computed. Its boundary cells (the open cells next to an open cell outside of the
+     * block) are computed when a neighbour publishes, and the flows through them are added to the mass every time
+     * step. The mass is kept exact: the open cells show its mean rounded down, and when it is spread over their
+     * states the remainder goes to the first cells. It is spread, and the observers notified, every options.interval
+     * time steps, when the coarse cell is split and at the end of run_until; in between, state() and the logs hold
+     * the last report.
+     * A coarse cell is split back into fine cells when a shopper comes within one block or an open neighbour differs
+     * from its mean by more than options.threshold. Merges and splits conserve the mass.
+     */
+    void set_adaptive(adaptive_options const &options) {
+        if (started) {
+            throw std::logic_error("the adaptive mode must be set before the simulation starts");
+        }
+        adaptive = options;
+        if (adaptive.block <= 1) {
+            adaptive.block = 0;
+            return;
+        }
+        adaptive.interval = std::max(1, adaptive.interval);
+        blocks_x = width / adaptive.block;
+        blocks_y = height / adaptive.block;
+        coarse.assign(blocks_x * blocks_y, 0);
+        block_mass.assign(blocks_x * blocks_y, 0);
+        block_cells.assign(blocks_x * blocks_y, {});
+        block_shown.assign(blocks_x * blocks_y, 0);
+        block_flow.assign(blocks_x * blocks_y, 0);
+        block_reported.assign(blocks_x * blocks_y, 1);
+        block_restless.assign(blocks_x * blocks_y, 0);
+        block_split.assign(blocks_x * blocks_y, 0);
+        edge_flow.assign(current.size(), 0);
+        in_flight.assign(current.size(), 0);
+        cell_block.assign(current.size(), -1);
+        for (int x = 0; x < blocks_x * adaptive.block; x++) {
+            for (int y = 0; y < blocks_y * adaptive.block; y++) {
+                cell_block[index(x, y)] = (x / adaptive.block) * blocks_y + y / adaptive.block;
+            }
+        }
+        block_edge.assign(current.size(), 0);
+        for (int i = 0; i < (int) current.size(); i++) {
+            if (cell_block[i] >= 0 && open[i]) {
+                for (int j : {i - 1, i + 1, i - stride, i + stride}) {
+                    block_edge[i] = block_edge[i] || (open[j] && cell_block[j] != cell_block[i]);
+                }
+            }
+        }
+    }
+
+    /*
+     * Fast-forward the idle periods of at least min_idle time steps (0 for never): when no shopper is in the store or
+     * waiting to come in and no cell is a CO2 source, the concentrations only relax towards the doors, windows and
+     * vents until the next arrival. Instead of computing every time step, the field is then advanced with implicit
+     * (backward Euler) steps of 1, 2, 4... time steps, each solved by successive over-relaxation; a long enough period
+     * ends at the steady state. The concentrations are rounded, the observers told that the time steps before the
+     * last one were skipped (see co2_observer::skip) and notified of the changed states at the last skipped time step,
+     * and the simulation goes on at the next arrival (or the end of run_until). If the rounded field is not steady,
+     * every open cell publishes it at that time, so the cells are computed again from there.
+     */
+    void set_fast_forward(int min_idle) {
+        fast_forward_idle = std::max(0, min_idle);
+    }
+
+    /*
+     * Run every time step before the given time (like Cadmium's run_until)
+     *
+     * observer: notified of the initial states and the state changes, nullptr for no log
+     */
+    void run_until(double time, co2_observer *observer) {
+        if (restored && observer != nullptr) {
+            //The observers start from the states of the checkpoint
+            observer->shape(width, height, 1);
+            observer->resume(reached);
+            for (int x = 0; x < width; x++) {
+                for (int y = 0; y < height; y++) {
+                    observer->initial_state(x, y, 0, current[index(x, y)]);
+                }
+            }
+        }
+        restored = false;
+        if (!started) {
+            //At time 0 every cell publishes its initial state
+            if (observer != nullptr) {
+                observer->shape(width, height, 1);
+            }
+            for (int x = 0; x < width; x++) {
+                for (int y = 0; y < height; y++) {
+                    publish_later(0, index(x, y), current[index(x, y)].concentration);
+                    if (observer != nullptr) {
+                        observer->initial_state(x, y, 0, current[index(x, y)]);
+                    }
+                }
+            }
+            started = true;
+        }
+        while (next_event() < time) {
+            auto t = (co2_tick) next_event();
+            auto until = (co2_tick) std::min(std::ceil(shoppers.next_arrival()), std::ceil(time));
+            if (fast_forward_idle > 0 && until - t >= fast_forward_idle && idle()) {
+                fast_forward(t, until, observer);
+            } else {
+                step(t, observer);
+            }
+        }
+        if (adaptive.block > 0) {
+            report_all(last_step, observer);
+        }
+        reached = std::max(reached, time);
+    }
+
+    /*
+     * Time up to which the simulation ran: every time step before it is done
+     */
+    [[nodiscard]] double time() const {
+        return reached;
+    }
+
+    /*
+     * Write a checkpoint: the state and the last published concentration of every cell, the pending publications,
+     * the shoppers and the counters. Resuming it with the same layout continues exactly like the original run.
+     */
+    void save(std::string const &file_path) const {
+        if (adaptive.block > 0) {
+            throw std::logic_error("checkpoints of adaptive runs are not supported");
+        }
+        checkpoint_writer out;
+        out.integer(width);
+        out.integer(height);
+        out.integer((int64_t) layout_hash);
+        out.real(reached);
+        out.integer(started);
+        out.integer(computations);
+        out.integer(state_changes);
+        for (int x = 0; x < width; x++) {
+            for (int y = 0; y < height; y++) {
+                out.state(current[index(x, y)]);
+                out.integer(visible[index(x, y)]);
+            }
+        }
+        auto publications = pending;
+        out.integer((int64_t) publications.size());
+        for (; !publications.empty(); publications.pop()) {
+            publication const &p = publications.top();
+            out.integer(publications.next_time());
+            out.integer(p.cell);
+            out.integer(p.concentration);
+        }
+        shoppers.save(out);
+        out.save(file_path);
+    }
+
+    /*
+     * Restore a checkpoint written by save() from a scenario with the same layout.
+     * The configuration of the cells (e.g. vent_conc) is the one of this scenario, so what-if runs can start from
+     * the same checkpoint. The next run_until notifies the observers of the restored states.
+     */
+    void load(std::string const &file_path) {
+        if (started) {
+            throw std::logic_error("a checkpoint can only be restored before the simulation starts");
+        }
+        checkpoint_reader in(file_path);
+        if (in.integer() != width || in.integer() != height || (uint64_t) in.integer() != layout_hash) {
+            throw std::invalid_argument(file_path + " is a checkpoint of another layout");
+        }
+        reached = in.real();
+        started = in.integer() != 0;
+        computations = (long) in.integer();
+        state_changes = (long) in.integer();
+        for (int x = 0; x < width; x++) {
+            for (int y = 0; y < height; y++) {
+                current[index(x, y)] = in.state();
+                visible[index(x, y)] = (int) in.integer();
+                settle(index(x, y));
+            }
+        }
+        auto publications = in.integer();
+        for (int64_t i = 0; i < publications; i++) {
+            co2_tick time = in.integer();
+            publication p{};
+            p.cell = (int) in.integer();
+            p.concentration = (int) in.integer();
+            pending.push(time, p);
+        }
+        shoppers.load(in);
+        restored = true;
+    }
+
+    [[nodiscard]] co2 const &state(int x, int y) const {
+        return current[index(x, y)];
+    }
+
+    [[nodiscard]] shopper_engine const &agents() const {
+        return shoppers;
+    }
+
+    shopper_engine &agents() {
+        return shoppers;
+    }
+
+    [[nodiscard]] int get_width() const { return width; }
+    [[nodiscard]] int get_height() const { return height; }
+
+    long computations = 0; //Local computations
+    long state_changes = 0; //Local computations that changed the state of the cell
+    long coarse_computations = 0; //Local computations of coarse cells (included in computations)
+    long merges = 0; //Blocks merged into a coarse cell
+    long splits = 0; //Coarse cells split back into fine cells
+    int coarse_cells = 0; //Current number of coarse cells
+
+    long fast_forwards = 0; //Idle periods skipped by the fast-forward
+    long fast_forward_steps = 0; //Time steps skipped by the fast-forward
+    long fast_forward_sweeps = 0; //Relaxation sweeps of the fast-forward solver
+
+    [[nodiscard]] adaptive_options const &adaptive_mode() const {
+        return adaptive;
+    }
+
+private:
+    // State published by a cell (the time is its tick in the calendar queue)
+    struct publication {
+        int cell;
+        int concentration;
+    };
+
+    [[nodiscard]] int index(int x, int y) const {
+        return (x + 1) * stride + (y + 1);
+    }
+
+    void publish_later(co2_tick time, int cell, int concentration) {
+        pending.push(time, {cell, concentration});
+        if (adaptive.block > 0) {
+            in_flight[cell]++;
+        }
+    }
+
+    [[nodiscard]] bool has_pending() const {
+        return !pending.empty();
+    }
+
+    [[nodiscard]] co2_tick next_time() const {
+        return pending.next_time();
+    }
+
+    /*
+     * return: the time of the next publication, shopper arrival or coarse cell to recompute, or infinity
+     */
+    [[nodiscard]] double next_event() const {
+        double arrival = std::ceil(shoppers.next_arrival());
+        if (!restless_blocks.empty() || !wake_blocks.empty()) {
+            arrival = std::min(arrival, (double) last_step + 1);
+        }
+        return has_pending()? std::min<double>((double) next_time(), arrival) : arrival;
+    }
+
+    /*
+     * A static cell (wall, door, window or vent) at its constant concentration never changes again
+     */
+    void settle(int i) {
+        co2 const &cell = current[i];
+        settled[i] = co2_rule::is_static(cell.type) && cell.concentration == rule.static_concentration(cell.type);
+    }
+
+    void activate(int i) {
+        for (int j : {i, i - 1, i + 1, i - stride, i + stride}) {
+            int x = j / stride - 1;
+            int y = j % stride - 1;
+            if (!active[j] && !settled[j] && x >= 0 && y >= 0 && x < width && y < height) {
+                active[j] = 1;
+                active_cells.push_back(j);
+            }
+        }
+    }
+
+    void wake(int i) {
+        if (!active[i]) {
+            active[i] = 1;
+            active_cells.push_back(i);
+        }
+    }
+
+    void step(co2_tick t, co2_observer *observer) {
+        //Deliver the publications of this time step
+        while (has_pending() && next_time() == t) {
+            publication const &p = pending.top();
+            visible[p.cell] = p.concentration;
+            if (adaptive.block > 0) {
+                in_flight[p.cell]--;
+            }
+            activate(p.cell);
+            pending.pop();
+        }
+        //The boundary cells of the blocks merged in the last time step, and every cell of the ones split
+        for (int b : wake_blocks) {
+            int x0 = (b / blocks_y) * adaptive.block;
+            int y0 = (b % blocks_y) * adaptive.block;
+            for (int x = x0; x < x0 + adaptive.block; x++) {
+                for (int y = y0; y < y0 + adaptive.block; y++) {
+                    int i = index(x, y);
+                    if (open[i] && (block_edge[i] || !coarse[b])) {
+                        wake(i);
+                    }
+                }
+            }
+        }
+        wake_blocks.clear();
+        //The entrances wake up when a shopper arrives
+        if (shoppers.next_arrival() <= t) {
+            for (auto const &entrance : shoppers.arrivals->entrances) {
+                wake(index(entrance.cell.first, entrance.cell.second));
+            }
+        }
+        std::sort(active_cells.begin(), active_cells.end());
+
+        //Movement phase, triggered by the first non-static cell computed at this time
+        for (int i : active_cells) {
+            if (!co2_rule::is_static(current[i].type)) {
+                shoppers.advance(t);
+                break;
+            }
+        }
+
+        if (adaptive.block > 0) {
+            split_near_shoppers(t, observer);
+            take_coarse_cells();
+        }
+
+        int tiles = (int) tile_changes.size();
+        {
+            CO2_PROFILE_TIME(diffusion);
+            if (pool != nullptr && active_cells.size() >= parallel_threshold) {
+                pool->run(tiles, [this](int tile) { compute_tile(tile); });
+            } else {
+                for (int tile = 0; tile < tiles; tile++) {
+                    compute_tile(tile);
+                }
+            }
+        }
+
+        //Publish and notify the new states in cell order
+        for (auto &changes : tile_changes) {
+            for (int i : changes) {
+                co2 const &new_state = current[i];
+                settle(i);
+                state_changes++;
+                CO2_PROFILE_COUNT(messages);
+                publish_later(t + rule.output_delay(new_state.type), i, new_state.concentration);
+                if (observer != nullptr) {
+                    observer->state_change((double) t, i / stride - 1, i % stride - 1, 0, new_state);
+                }
+            }
+            changes.clear();
+        }
+        if (adaptive.block > 0) {
+            compute_blocks(t);
+        }
+        for (int i : active_cells) {
+            active[i] = 0;
+        }
+        computations += (long) active_cells.size();
+        active_cells.clear();
+        if (adaptive.block > 0) {
+            adapt(t, observer);
+        }
+        last_step = t;
+    }
+
+    /*
+     * return true if no shopper is in the store or waiting, and no cell is a CO2 source
+     */
+    [[nodiscard]] bool idle() const {
+        return adaptive.block == 0 && shoppers.empty() &&
+               std::none_of(current.begin(), current.end(), [](co2 const &cell) { return cell.type == CO2_SOURCE; });
+    }
+
+    /*
+     * Advance the concentrations over the time steps [from, until) (see set_fast_forward).
+     * Every time step replaces the concentration of the open non-static cells with the average of their open
+     * neighbourhood: x' = M x. A backward Euler step of h time steps solves (1 + h) x - h M x = x_old.
+     */
+    void fast_forward(co2_tick from, co2_tick until, co2_observer *observer) {
+        //Open cells that are not static, the cells with an even x + y first: the cells of one colour only have
+        //neighbours of the other colour, so every half sweep can update them in any order
+        std::vector<int> cells;
+        std::size_t even = 0;
+        std::vector<double> x(current.size(), 0);
+        for (int colour = 0; colour < 2; colour++) {
+            even = cells.size();
+            for (int i = 0; i < (int) current.size(); i++) {
+                if (open[i] && co2_rule::is_static(current[i].type)) {
+                    x[i] = rule.static_concentration(current[i].type);
+                } else if (open[i] && (i / stride + i % stride) % 2 == colour) {
+                    x[i] = current[i].concentration;
+                    cells.push_back(i);
+                }
+            }
+        }
+
+        //Spectral radius of the Jacobi iteration of the slowest mode, for the over-relaxation factor (the neighbours of
+        //an inner cell weigh 1 - 1/5 = 0.8)
+        double slowest = std::cos(std::acos(-1.0) / std::max(width, height));
+        std::vector<double> rhs(cells.size()); //x_old / (1 + h (1 - w)), with w = 1 / cells in the open neighbourhood
+        std::vector<double> spread(cells.size()); //h w / (1 + h (1 - w))
+        for (co2_tick done = 0, h = 1; done < until - from; done += h, h *= 2) {
+            h = std::min(h, until - from - done);
+            for (std::size_t k = 0; k < cells.size(); k++) {
+                int i = cells[k];
+                double w = 1.0 / (open[i] + open[i - 1] + open[i + 1] + open[i - stride] + open[i + stride]);
+                double keep = 1 / (1 + (double) h * (1 - w));
+                rhs[k] = x[i] * keep;
+                spread[k] = (double) h * w * keep;
+            }
+            double rho = slowest * (0.8 * (double) h) / (1 + 0.8 * (double) h);
+            double omega = 2 / (1 + std::sqrt(1 - rho * rho));
+            for (long sweep = 0; sweep < 100L * (width + height); sweep++) {
+                fast_forward_sweeps++;
+                double change = 0;
+                for (auto [first, last] : {std::make_pair((std::size_t) 0, even), std::make_pair(even, cells.size())}) {
+                    for (std::size_t k = first; k < last; k++) {
+                        int i = cells[k];
+                        double next = rhs[k] + spread[k] * (x[i - 1] + x[i + 1] + x[i - stride] + x[i + stride]);
+                        double step = omega * (next - x[i]);
+                        x[i] += step;
+                        change = std::max(change, std::abs(step));
+                    }
+                }
+                if (change < 1e-2) {
+                    break;
+                }
+            }
+        }
+
+        //The publications in flight are superseded by the new concentrations
+        while (has_pending()) {
+            pending.pop();
+        }
+        if (observer != nullptr) {
+            observer->skip((double) from, (double) (until - 1));
+        }
+        for (int i = 0; i < (int) current.size(); i++) {
+            if (!open[i]) {
+                continue;
+            }
+            auto concentration = (int) std::lround(x[i]);
+            visible[i] = concentration;
+            if (current[i].concentration != concentration) {
+                current[i].concentration = concentration;
+                settle(i);
+                state_changes++;
+                if (observer != nullptr) {
+                    observer->state_change((double) (until - 1), i / stride - 1, i % stride - 1, 0, current[i]);
+                }
+            }
+        }
+
+        //Unless the rounded field is a fixed point of the local rule, every open cell publishes its new concentration
+        //at the end of the period, so its neighbourhood is computed again and the time steps go on from there
+        bool steady = true;
+        for (int i : cells) {
+            diffuse(i);
+            co2 next = rule.next_state(current[i], average[i], false);
+            steady = steady && (!(next != current[i]) || rule.below_quantum(current[i], next));
+        }
+        if (!steady) {
+            for (int i = 0; i < (int) current.size(); i++) {
+                if (open[i] && !settled[i]) {
+                    publish_later(until, i, current[i].concentration);
+                }
+            }
+        }
+        fast_forwards++;
+        fast_forward_steps += until - from;
+    }
+
+    /*
+     * Call f(block) for every block within one block of a shopper
+     */
+    template <typename F>
+    void for_blocks_near_shoppers(F f) const {
+        occupancy_grid const &occupancy = shoppers.index();
+        int a = adaptive.block;
+        for (int id = 0; id < occupancy.size(); id++) {
+            auto location = occupancy.shopper(id).location;
+            if (location.first < 0 || location.second < 0) {
+                continue;
+            }
+            for (int bx = std::max(0, location.first - a) / a; bx <= std::min(blocks_x - 1, (location.first + a) / a); bx++) {
+                for (int by = std::max(0, location.second - a) / a; by <= std::min(blocks_y - 1, (location.second + a) / a); by++) {
+                    f(bx * blocks_y + by);
+                }
+            }
+        }
+    }
+
+    void split_near_shoppers(co2_tick t, co2_observer *observer) {
+        if (coarse_cells > 0) {
+            for_blocks_near_shoppers([this, t, observer](int b) {
+                if (coarse[b]) {
+                    split(b, t, observer);
+                }
+            });
+        }
+    }
+
+    /*
+     * Move the active cells of the coarse cells out of the fine computation: only their boundary cells are computed
+     */
+    void take_coarse_cells() {
+        if (coarse_cells == 0) {
+            return;
+        }
+        auto kept = active_cells.begin();
+        for (int i : active_cells) {
+            int b = cell_block[i];
+            if (b >= 0 && coarse[b]) {
+                active[i] = 0;
+                if (block_edge[i]) {
+                    coarse_active.push_back(i);
+                }
+            } else {
+                *kept++ = i;
+            }
+        }
+        active_cells.erase(kept, active_cells.end());
+    }
+
+    /*
+     * Compute the coarse cells. An active boundary cell is computed like a fine cell holding the concentration shown
+     * by its block, and its change (the flow through it) is kept in edge_flow until it is computed again. Every
+     * time step, the coarse cells add the sum of the flows of their boundary cells to their mass.
+     */
+    void compute_blocks(co2_tick t) {
+        for (int i : coarse_active) {
+            int b = cell_block[i];
+            CO2_PROFILE_CELL(current[i].type);
+            diffuse(i);
+            int flow = average[i] - block_shown[b];
+            block_flow[b] += flow - edge_flow[i];
+            edge_flow[i] = flow;
+            if (!block_restless[b]) {
+                block_restless[b] = 1;
+                restless_blocks.push_back(b);
+            }
+            if (!block_split[b]) {
+                for (int j : {i - 1, i + 1, i - stride, i + stride}) {
+                    if (open[j] && cell_block[j] != b && std::abs(visible[j] - block_shown[b]) > adaptive.threshold) {
+                        block_split[b] = 1;
+                        split_blocks.push_back(b);
+                        break;
+                    }
+                }
+            }
+        }
+        computations += (long) coarse_active.size();
+        coarse_active.clear();
+
+        auto kept = restless_blocks.begin();
+        for (int b : restless_blocks) {
+            if (!coarse[b] || block_flow[b] == 0) {
+                block_restless[b] = 0;
+                continue;
+            }
+            //The mass is kept exact: it is only rounded when it is shown or spread over the cells
+            block_mass[b] += block_flow[b];
+            block_reported[b] = 0;
+            coarse_computations++;
+            show(b, t);
+            *kept++ = b;
+        }
+        restless_blocks.erase(kept, restless_blocks.end());
+    }
+
+    /*
+     * Show the mean concentration of a coarse cell to its open cells if it changed: inner cells at once, boundary
+     * cells by publishing it like fine cells
+     */
+    void show(int b, co2_tick t) {
+        auto shown = (int) (block_mass[b] / (int64_t) block_cells[b].size());
+        if (shown == block_shown[b]) {
+            return;
+        }
+        block_shown[b] = shown;
+        for (int i : block_cells[b]) {
+            if (block_edge[i]) {
+                publish_later(t + 1, i, shown);
+            } else {
+                visible[i] = shown;
+            }
+        }
+    }
+
+    /*
+     * Spread the mass of a coarse cell over the states of its open cells and notify the observers of the changed
+     * states: the k-th open cell holds mass / cells, plus one if k < mass % cells
+     */
+    void report(int b, co2_tick t, co2_observer *observer) {
+        auto const &cells = block_cells[b];
+        auto n = (int64_t) cells.size();
+        for (int64_t k = 0; k < n; k++) {
+            int i = cells[k];
+            auto concentration = (int) (block_mass[b] / n + ((k < block_mass[b] % n)? 1 : 0));
+            if (current[i].concentration != concentration) {
+                current[i].concentration = concentration;
+                state_changes++;
+                if (observer != nullptr) {
+                    observer->state_change((double) t, i / stride - 1, i % stride - 1, 0, current[i]);
+                }
+            }
+        }
+        block_reported[b] = 1;
+    }
+
+    /*
+     * End of a time step: split the coarse cells marked by compute_blocks, and every interval, report the coarse
+     * cells and look for blocks to merge
+     */
+    void adapt(co2_tick t, co2_observer *observer) {
+        for (int b : split_blocks) {
+            if (coarse[b]) {
+                split(b, t, observer);
+            }
+            block_split[b] = 0;
+        }
+        split_blocks.clear();
+        if (t % adaptive.interval != 0) {
+            return;
+        }
+        report_all(t, observer);
+        std::vector<char> near(coarse.size(), 0);
+        for_blocks_near_shoppers([&near](int b) { near[b] = 1; });
+        for (int b = 0; b < (int) coarse.size(); b++) {
+            if (!coarse[b] && !near[b]) {
+                merge(b, t);
+            }
+        }
+    }
+
+    void report_all(co2_tick t, co2_observer *observer) {
+        for (int b = 0; b < (int) coarse.size(); b++) {
+            if (coarse[b] && !block_reported[b]) {
+                report(b, t, observer);
+            }
+        }
+    }
+
+    /*
+     * Merge a block into a coarse cell if it is quiescent
+     */
+    void merge(int b, co2_tick t) {
+        int x0 = (b / blocks_y) * adaptive.block;
+        int y0 = (b % blocks_y) * adaptive.block;
+        std::vector<int> cells;
+        int low = std::numeric_limits<int>::max();
+        int high = std::numeric_limits<int>::min();
+        int64_t mass = 0;
+        for (int x = x0; x < x0 + adaptive.block; x++) {
+            for (int y = y0; y < y0 + adaptive.block; y++) {
+                int i = index(x, y);
+                CELL_TYPE type = current[i].type;
+                if (in_flight[i] != 0 || (type != AIR && type != IMPERMEABLE_STRUCTURE && !store_layout::is_zone(type))) {
+                    return;
+                }
+                if (open[i]) {
+                    cells.push_back(i);
+                    low = std::min(low, current[i].concentration);
+                    high = std::max(high, current[i].concentration);
+                    mass += current[i].concentration;
+                }
+            }
+        }
+        if (cells.size() < 2 || high - low > adaptive.threshold / 2) {
+            return;
+        }
+        int64_t mean = mass / (int64_t) cells.size();
+        for (int i : cells) {
+            for (int j : {i - 1, i + 1, i - stride, i + stride}) {
+                if (block_edge[i] && open[j] && cell_block[j] != b && std::abs(visible[j] - mean) > adaptive.threshold / 2) {
+                    return;
+                }
+            }
+        }
+        if (!connected(b, cells)) {
+            return;
+        }
+        coarse[b] = 1;
+        coarse_cells++;
+        merges++;
+        //The fine states stay as they are until the next report, which spreads the mass with the inner cells first
+        std::stable_partition(cells.begin(), cells.end(), [this](int i) { return !block_edge[i]; });
+        block_cells[b] = std::move(cells);
+        block_mass[b] = mass;
+        block_flow[b] = 0;
+        block_reported[b] = 1;
+        for (int i : block_cells[b]) {
+            edge_flow[i] = 0;
+        }
+        block_shown[b] = -1;
+        show(b, t);
+        //The flows through the boundary are computed in the next time step
+        wake_blocks.push_back(b);
+    }
+
+    /*
+     * return true if the open cells of a block are connected without leaving the block (else merging them would move
+     * CO2 across the walls)
+     */
+    [[nodiscard]] bool connected(int b, std::vector<int> const &cells) const {
+        std::vector<int> reached = {cells.front()};
+        std::vector<char> seen(adaptive.block * adaptive.block, 0);
+        auto local = [this](int i) { return ((i / stride - 1) % adaptive.block) * adaptive.block + (i % stride - 1) % adaptive.block; };
+        seen[local(cells.front())] = 1;
+        for (std::size_t next = 0; next < reached.size(); next++) {
+            int i = reached[next];
+            for (int j : {i - 1, i + 1, i - stride, i + stride}) {
+                if (open[j] && cell_block[j] == b && !seen[local(j)]) {
+                    seen[local(j)] = 1;
+                    reached.push_back(j);
+                }
+            }
+        }
+        return reached.size() == cells.size();
+    }
+
+    /*
+     * Split a coarse cell: its mass is spread over its open cells, which become fine cells again and are all computed
+     * in the next time step
+     */
+    void split(int b, co2_tick t, co2_observer *observer) {
+        report(b, t, observer);
+        for (int i : block_cells[b]) {
+            if (!block_edge[i]) {
+                visible[i] = current[i].concentration;
+            } else if (visible[i] != current[i].concentration) {
+                publish_later(t + 1, i, current[i].concentration);
+            }
+        }
+        coarse[b] = 0;
+        coarse_cells--;
+        splits++;
+        std::vector<int>().swap(block_cells[b]);
+        wake_blocks.push_back(b);
+    }
+
+    /*
+     * Run f(x0, x1) on the columns [x0, x1) of every tile, in parallel if there is a thread pool
+     */
+    template <typename F>
+    void for_each_tile(F f) {
+        int tiles = (int) tile_changes.size();
+        if (pool != nullptr) {
+            pool->run(tiles, [this, &f](int tile) { f(tile_bounds[tile], tile_bounds[tile + 1]); });
+        } else {
+            f(0, width);
+        }
+    }
+
+    /*
+     * Compute the active cells of the columns of one tile. Only the cells of the tile are written.
+     */
+    void compute_tile(int tile) {
+        int x0 = tile_bounds[tile];
+        int x1 = tile_bounds[tile + 1];
+        auto first = std::lower_bound(active_cells.begin(), active_cells.end(), (x0 + 1) * stride);
+        auto last = std::lower_bound(first, active_cells.end(), (x1 + 1) * stride);
+        if ((last - first) * 4 > (x1 - x0) * height) {
+            diffuse_columns(x0, x1);
+        } else {
+            for (auto i = first; i != last; i++) {
+                diffuse(*i);
+            }
+        }
+
+        auto &changes = tile_changes[tile];
+        for (auto it = first; it != last; it++) {
+            int i = *it;
+            co2 const &state = current[i];
+            CO2_PROFILE_CELL(state.type);
+            co2 new_state = rule.next_state(state, average[i], shoppers.occupied(i / stride - 1, i % stride - 1));
+            if (!(new_state != state) || rule.below_quantum(state, new_state)) {
+                continue;
+            }
+            current[i] = new_state;
+            changes.push_back(i);
+        }
+    }
+
+    /*
+     * Neighbourhood average of one cell
+     */
+    void diffuse(int i) {
+        int sum = open[i] * visible[i] + open[i - 1] * visible[i - 1] + open[i + 1] * visible[i + 1] +
+                  open[i - stride] * visible[i - stride] + open[i + stride] * visible[i + stride];
+        average[i] = (int) (((uint64_t) sum * reciprocal[i]) >> 32);
+    }
+
+    /*
+     * Neighbourhood average of every cell in the columns [x0, x1). The loop has no branches so the compiler can vectorize it.
+     */
+    void diffuse_columns(int x0, int x1) {
+        int const *__restrict v = visible.data();
+        int const *__restrict o = open.data();
+        uint64_t const *__restrict r = reciprocal.data();
+        int *__restrict a = average.data();
+        int const s = stride;
+        int const first = (x0 + 1) * stride;
+        int const last = (x1 + 1) * stride;
+        for (int i = first; i < last; i++) {
+            int sum = o[i] * v[i] + o[i - 1] * v[i - 1] + o[i + 1] * v[i + 1] + o[i - s] * v[i - s] + o[i + s] * v[i + s];
+            a[i] = (int) (((uint64_t) sum * r[i]) >> 32);
+        }
+    }
+
+    int width;
+    int height;
+    int stride; //Distance between two columns of the padded arrays
+    co2_rule rule;
+    shopper_engine shoppers;
+    bool started = false;
+    double reached = 0; //Time passed to the last run_until
+    bool restored = false; //A checkpoint was loaded and the observers were not notified yet
+    uint64_t layout_hash = 14695981039346656037ULL;
+
+    // Arrays over the lattice plus a border of impermeable cells
+    std::vector<co2> current; //State of every cell
+    std::vector<int> visible; //Concentration last published by every cell
+    std::vector<int> open; //1 for permeable cells, 0 for impermeable ones
+    std::vector<uint64_t> reciprocal; //ceil(2^32 / number of permeable cells in the neighbourhood)
+    std::vector<int> average; //Neighbourhood average of the current time step
+    std::vector<char> active; //Cells to compute in the current time step
+    std::vector<char> settled; //1 for the static cells at their constant concentration, which are never computed (see settle)
+    std::vector<int> active_cells;
+
+    calendar_queue<publication> pending;
+
+    // Adaptive resolution (see set_adaptive)
+    adaptive_options adaptive;
+    int blocks_x = 0; //Aligned blocks along x; the last columns of the lattice may not belong to any block
+    int blocks_y = 0;
+    std::vector<char> coarse; //1 for the blocks simulated as a coarse cell
+    std::vector<int64_t> block_mass; //Sum of the concentrations of the open cells of every coarse cell
+    std::vector<std::vector<int>> block_cells; //Open cells of every coarse cell, inner cells first
+    std::vector<int> block_shown; //Mean concentration shown by the open cells of every coarse cell
+    std::vector<int64_t> block_flow; //Sum of the flows through the boundary cells of every coarse cell
+    std::vector<char> block_reported; //0 for the coarse cells whose mass changed since their last report
+    std::vector<char> block_restless; //1 for the coarse cells whose mass may change in the next time step
+    std::vector<int> restless_blocks;
+    std::vector<int> wake_blocks; //Blocks merged or split in the last time step, to compute in this one
+    std::vector<char> block_split; //Coarse cells to split at the end of the current time step
+    std::vector<int> split_blocks;
+    std::vector<int> coarse_active; //Active boundary cells of the coarse cells in the current time step
+    std::vector<int> edge_flow; //Last flow computed through every boundary cell of a coarse cell
+    co2_tick last_step = 0; //Time of the last time step
+    std::vector<uint16_t> in_flight; //Publications of every cell not delivered yet
+    std::vector<int> cell_block; //Block of every cell, -1 out of the aligned blocks
+    std::vector<char> block_edge; //1 for the open cells of a block next to an open cell outside of it
+
+    int fast_forward_idle = 0; //Minimum idle time steps to fast-forward, 0 for never (see set_fast_forward)
+
+    // Parallel execution
+    static constexpr std::size_t parallel_threshold = 4096; //Minimum active cells to use the thread pool
+    std::vector<int> tile_bounds; //First column of every tile, plus the width
+    std::vector<std::vector<int>> tile_changes; //Cells changed by every tile in the current time step
+    std::unique_ptr<thread_pool> pool;
+};
+
+#endif //CADMIUM_CELLDEVS_CO2_STENCIL_HPP
@@ -0,0 +1,395 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CADMIUM_CELLDEVS_CO2_VOLUME_HPP
+#define CADMIUM_CELLDEVS_CO2_VOLUME_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include "calendar_queue.hpp"
+#include "co2_observers.hpp"
+#include "co2_profile.hpp"
+#include "co2_rule.hpp"
+#include "co2_scenario.hpp"
+#include "shopper_engine.hpp"
+
+/*
+ * Execution of the CO2 model on 3D store volumes (x, y, z), with z = 0 the floor where the shoppers walk.
+ *
+ * It follows the same rules as the stencil engine (transport delays, a cell is only computed at the times one of its
+ * neighbours or itself publishes), with a von Neumann neighbourhood of range 1 in three dimensions: the cell and its
+ * six face neighbours.
+ * Shelves, walls and the other solid regions usually fill most of a store volume, so they are not stored:
+ * an impermeable cell at its constant concentration (0) never changes and is masked out of every average.
+ * Only the other cells are kept, in arrays ordered by cell index (x * height + y) * depth + z, with the
+ * array positions of their neighbours; a missing neighbour points to a sentinel slot that is never permeable.
+ * The memory of the engine is proportional to the number of air (non-solid) cells, not to the volume of the store.
+ * Read with sparse = true, the scenario does not hold the volume either: only the cells listed in its file are kept,
+ * and when the default state is solid only they are visited.
+ *
+ * 2D scenarios run as volumes of depth 1 and give the same results as the stencil engine.
+ */
+class co2_volume {
+public:
+    explicit co2_volume(co2_scenario const &scenario) : co2_volume(scenario, scenario.config) {}
+
+    /*
+     * Run the layout of the scenario with another CO2_cell configuration
+     */
+    co2_volume(co2_scenario const &scenario, conc const &config) :
+            width(scenario.width), height(scenario.height), depth(scenario.depth), rule(config) {
+        shoppers.total_shoppers = config.totalStudents;
+        shoppers.arrivals = scenario.arrivals;
+        shoppers.reserve(width, height);
+        for (int x = 0; x < width; x++) {
+            for (int y = 0; y < height; y++) {
+                shoppers.add_cell(x, y, scenario.at(x, y, 0).type);
+            }
+        }
+        //The cell indexes of the scenario are the keys, and its listed cells are sorted by id, that is by key:
+        //every branch visits the cells in key order
+        auto const &listed = scenario.listed;
+        auto listed_key = [&](std::size_t i) {
+            return key(listed[i].cell_id[0], listed[i].cell_id[1], listed[i].cell_id[2]);
+        };
+        uint64_t total = (uint64_t) width * height * depth;
+        auto visit = [&](auto &&f) {
+            if (!scenario.sparse) {
+                for (uint64_t k = 0; k < total; k++) {
+                    f(k, scenario.cells[k]);
+                }
+            } else if (solid(scenario.default_state)) {
+                for (std::size_t i = 0; i < listed.size(); i++) {
+                    f(listed_key(i), listed[i].state);
+                }
+            } else {
+                std::size_t next = 0;
+                for (uint64_t k = 0; k < total; k++) {
+                    if (next < listed.size() && listed_key(next) == k) {
+                        f(k, listed[next++].state);
+                    } else {
+                        f(k, scenario.default_state);
+                    }
+                }
+            }
+        };
+        //Counted first, so that the arrays are allocated once at their size
+        std::size_t stored = 0;
+        visit([&](uint64_t, co2 const &cell) { stored += solid(cell)? 0 : 1; });
+        keys.reserve(stored);
+        current.reserve(stored);
+        visit([&](uint64_t k, co2 const &cell) {
+            if (!solid(cell)) {
+                keys.push_back(k);
+                current.push_back(cell);
+            }
+        });
+        int n = (int) keys.size();
+        sentinel = n;
+        visible.assign(n + 1, 0);
+        open.assign(n + 1, 0);
+        reciprocal.assign(n, 0);
+        active.assign(n, 0);
+        neighbors.resize(n);
+        for (int i = 0; i < n; i++) {
+            open[i] = (current[i].type != IMPERMEABLE_STRUCTURE)? 1 : 0;
+        }
+        //The keys are sorted, so the neighbours in one direction come in increasing key order too:
+        //one cursor per direction finds all of them in a single pass instead of one binary search per neighbour
+        static constexpr int moves[6][3] = {{-1, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1}};
+        std::array<int, 6> cursors{};
+        for (int i = 0; i < n; i++) {
+            int x, y, z;
+            position(keys[i], x, y, z);
+            for (int d = 0; d < 6; d++) {
+                int nx = x + moves[d][0];
+                int ny = y + moves[d][1];
+                int nz = z + moves[d][2];
+                if (nx < 0 || ny < 0 || nz < 0 || nx >= width || ny >= height || nz >= depth) {
+                    neighbors[i][d] = sentinel;
+                    continue;
+                }
+                uint64_t k = key(nx, ny, nz);
+                int &c = cursors[d];
+                while (c < n && keys[c] < k) {
+                    c++;
+                }
+                neighbors[i][d] = (c < n && keys[c] == k)? c : sentinel;
+            }
+            int count = open[i];
+            for (int j : neighbors[i]) {
+                count += open[j];
+            }
+            reciprocal[i] = (count > 0)? ((uint64_t(1) << 32) + count - 1) / count : 0;
+        }
+    }
+
+    /*
+     * Run every time step before the given time
+     *
+     * observer: notified of the initial states and the state changes, nullptr for no log
+     */
+    void run_until(double time, co2_observer *observer) {
+        if (!started) {
+            //At time 0 every cell publishes its initial state; the solid cells would not change anything
+            for (int i = 0; i < (int) keys.size(); i++) {
+                publish_later(0, i, current[i].concentration);
+            }
+            if (observer != nullptr) {
+                notify_initial(observer);
+            }
+            started = true;
+        }
+        while (next_event() < time) {
+            step((co2_tick) next_event(), observer);
+        }
+        reached = std::max(reached, time);
+    }
+
+    /*
+     * Time up to which the simulation ran: every time step before it is done
+     */
+    [[nodiscard]] double time() const {
+        return reached;
+    }
+
+    [[nodiscard]] co2 const &state(int x, int y, int z = 0) const {
+        int i = find(x, y, z);
+        return (i == sentinel)? solid_state : current[i];
+    }
+
+    [[nodiscard]] shopper_engine const &agents() const {
+        return shoppers;
+    }
+
+    shopper_engine &agents() {
+        return shoppers;
+    }
+
+    [[nodiscard]] int get_width() const { return width; }
+    [[nodiscard]] int get_height() const { return height; }
+    [[nodiscard]] int get_depth() const { return depth; }
+
+    /*
+     * return: the number of cells stored (every cell but the solid ones)
+     */
+    [[nodiscard]] std::size_t stored_cells() const {
+        return keys.size();
+    }
+
+    /*
+     * return: the bytes used by the arrays of the cells
+     */
+    [[nodiscard]] std::size_t memory() const {
+        return keys.capacity() * sizeof(uint64_t) + current.capacity() * sizeof(co2) +
+               visible.capacity() * sizeof(int) + open.capacity() + reciprocal.capacity() * sizeof(uint64_t) +
+               active.capacity() + neighbors.capacity() * sizeof(std::array<int, 6>);
+    }
+
+    long computations = 0; //Local computations
+    long state_changes = 0; //Local computations that changed the state of the cell
+
+private:
+    // State published by a cell (the time is its tick in the calendar queue)
+    struct publication {
+        int cell;
+        int concentration;
+    };
+
+    [[nodiscard]] bool solid(co2 const &cell) const {
+        return cell.type == IMPERMEABLE_STRUCTURE && cell.concentration == rule.static_concentration(IMPERMEABLE_STRUCTURE);
+    }
+
+    [[nodiscard]] uint64_t key(int x, int y, int z) const {
+        return ((uint64_t) x * height + y) * depth + z;
+    }
+
+    void position(uint64_t k, int &x, int &y, int &z) const {
+        z = (int) (k % depth);
+        k /= depth;
+        y = (int) (k % height);
+        x = (int) (k / height);
+    }
+
+    /*
+     * return: the array position of a cell, or the sentinel for solid cells and cells outside of the store
+     */
+    [[nodiscard]] int find(int x, int y, int z) const {
+        if (x < 0 || y < 0 || z < 0 || x >= width || y >= height || z >= depth) {
+            return sentinel;
+        }
+        uint64_t k = key(x, y, z);
+        auto it = std::lower_bound(keys.begin(), keys.end(), k);
+        return (it != keys.end() && *it == k)? (int) (it - keys.begin()) : sentinel;
+    }
+
+    /*
+     * Initial state of every cell of the store, the solid ones included, in cell order
+     */
+    void notify_initial(co2_observer *observer) const {
+        observer->shape(width, height, depth);
+        std::size_t next = 0;
+        uint64_t k = 0;
+        for (int x = 0; x < width; x++) {
+            for (int y = 0; y < height; y++) {
+                for (int z = 0; z < depth; z++, k++) {
+                    if (next < keys.size() && keys[next] == k) {
+                        observer->initial_state(x, y, z, current[next++]);
+                    } else {
+                        observer->initial_state(x, y, z, solid_state);
+                    }
+                }
+            }
+        }
+    }
+
+    void publish_later(co2_tick time, int cell, int concentration) {
+        pending.push(time, {cell, concentration});
+    }
+
+    /*
+     * return: the time of the next publication or shopper arrival, or infinity
+     */
+    [[nodiscard]] double next_event() const {
+        double arrival = std::ceil(shoppers.next_arrival());
+        return pending.empty()? arrival : std::min<double>((double) pending.next_time(), arrival);
+    }
+
+    void wake(int i) {
+        if (i != sentinel && !active[i]) {
+            active[i] = 1;
+            active_cells.push_back(i);
+        }
+    }
+
+    void activate(int i) {
+        if (!active[i]) {
+            active[i] = 1;
+            active_cells.push_back(i);
+        }
+        for (int j : neighbors[i]) {
+            if (j != sentinel && !active[j]) {
+                active[j] = 1;
+                active_cells.push_back(j);
+            }
+        }
+    }
+
+    void step(co2_tick t, co2_observer *observer) {
+        //Deliver the publications of this time step
+        while (!pending.empty() && pending.next_time() == t) {
+            publication const &p = pending.top();
+            visible[p.cell] = p.concentration;
+            activate(p.cell);
+            pending.pop();
+        }
+        //The entrances wake up when a shopper arrives
+        if (shoppers.next_arrival() <= t) {
+            for (auto const &entrance : shoppers.arrivals->entrances) {
+                wake(find(entrance.cell.first, entrance.cell.second, 0));
+            }
+        }
+        std::sort(active_cells.begin(), active_cells.end());
+
+        //Movement phase, triggered by the first non-static cell computed at this time
+        for (int i : active_cells) {
+            if (!co2_rule::is_static(current[i].type)) {
+                shoppers.advance(t);
+                break;
+            }
+        }
+
+        {
+            CO2_PROFILE_TIME(diffusion);
+            for (int i : active_cells) {
+                co2 const &state = current[i];
+                CO2_PROFILE_CELL(state.type);
+                int sum = open[i] * visible[i];
+                for (int j : neighbors[i]) {
+                    sum += open[j] * visible[j];
+                }
+                int average = (int) (((uint64_t) sum * reciprocal[i]) >> 32);
+                int x, y, z;
+                position(keys[i], x, y, z);
+                bool occupied = z == 0 && shoppers.occupied(x, y);
+                co2 new_state = rule.next_state(state, average, occupied);
+                if (!(new_state != state) || rule.below_quantum(state, new_state)) {
+                    continue;
+                }
+                current[i] = new_state;
+                changes.push_back(i);
+            }
+        }
+
+        //Publish and notify the new states in cell order
+        for (int i : changes) {
+            co2 const &new_state = current[i];
+            state_changes++;
+            CO2_PROFILE_COUNT(messages);
+            publish_later(t + rule.output_delay(new_state.type), i, new_state.concentration);
+            if (observer != nullptr) {
+                int x, y, z;
+                position(keys[i], x, y, z);
+                observer->state_change((double) t, x, y, z, new_state);
+            }
+        }
+        changes.clear();
+        for (int i : active_cells) {
+            active[i] = 0;
+        }
+        computations += (long) active_cells.size();
+        active_cells.clear();
+    }
+
+    int width;
+    int height;
+    int depth;
+    co2_rule rule;
+    shopper_engine shoppers;
+    bool started = false;
+    double reached = 0; //Time passed to the last run_until
+    co2 const solid_state = co2(-1, 0, IMPERMEABLE_STRUCTURE); //State of the cells that are not stored
+
+    // Arrays over the stored cells, in cell order; visible and open have one more slot, the sentinel
+    int sentinel = 0; //Position of the sentinel slot (the number of stored cells)
+    std::vector<uint64_t> keys; //Cell index of every stored cell
+    std::vector<co2> current; //State of every cell
+    std::vector<int> visible; //Concentration last published by every cell
+    std::vector<uint8_t> open; //1 for permeable cells, 0 for impermeable ones
+    std::vector<uint64_t> reciprocal; //ceil(2^32 / number of permeable cells in the neighbourhood)
+    std::vector<char> active; //Cells to compute in the current time step
+    std::vector<std::array<int, 6>> neighbors; //Positions of the face neighbours: x - 1, x + 1, y - 1, y + 1, z - 1, z + 1
+    std::vector<int> active_cells;
+    std::vector<int> changes;
+
+    calendar_queue<publication> pending;
+};
+
+#endif //CADMIUM_CELLDEVS_CO2_VOLUME_HPP
@@ -0,0 +1,444 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CADMIUM_CELLDEVS_CO2_LIVE_STREAM_HPP
+#define CADMIUM_CELLDEVS_CO2_LIVE_STREAM_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "co2_observers.hpp"
+
+/*
+ * Live output of a running simulation through a POSIX shared memory segment (e.g. /dev/shm/co2_live).
+ *
+ * The segment holds a header and a single-producer single-consumer ring of frames. The producer (the simulation)
+ * only advances the write position and the consumer (a viewer) only advances the read position, so neither side
+ * takes a lock. A frame is the changed cells of one time step; a keyframe holds every cell:
+ *   frame:  size (u32, whole frame) type ('K' or 'D', u32) time (f64) cells (u32) merged steps (u32)
+ *   cell:   index ((x * height + y) * depth + z), counter, concentration, type (i32 each)
+ * Frames may wrap around the end of the ring.
+ *
+ * The simulation never waits for the viewer: if a frame does not fit in the free part of the ring, its cells stay
+ * pending and are merged with the changes of the next time steps (only the last state of every cell is kept),
+ * so a slow viewer sees fewer, larger frames but always ends up with the exact states.
+ * A viewer that attaches late asks for a keyframe, which is sent with the next frame.
+ */
+namespace co2_live {
+    static constexpr char magic[4] = {'C', 'O', '2', 'L'};
+    static constexpr uint32_t version = 1;
+
+    struct header {
+        char magic[4];
+        uint32_t version;
+        int32_t width;
+        int32_t height;
+        int32_t depth;
+        uint32_t padding;
+        uint64_t capacity; //Bytes of the ring
+        std::atomic<uint64_t> write; //Bytes written since the start (producer)
+        std::atomic<uint64_t> read; //Bytes consumed since the start (consumer)
+        std::atomic<uint32_t> keyframe_request; //Set by the consumer, cleared by the producer
+        std::atomic<uint32_t> finished; //Set by the producer at the end of the simulation
+        std::atomic<uint64_t> frames; //Frames written
+        std::atomic<uint64_t> merged_steps; //Time steps merged into a later frame because the ring was full
+    };
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "the live stream needs lock-free 64-bit atomics");
+
+    struct frame_header {
+        uint32_t size;
+        uint32_t type;
+        double time;
+        uint32_t cells;
+        uint32_t merged;
+    };
+
+    struct cell {
+        int32_t index;
+        int32_t counter;
+        int32_t concentration;
+        int32_t type;
+    };
+
+    /*
+     * Copy bytes into the ring at the given stream position
+     */
+    inline void ring_write(char *ring, uint64_t capacity, uint64_t position, void const *data, std::size_t size) {
+        auto offset = (std::size_t) (position % capacity);
+        std::size_t first = std::min<std::size_t>(size, capacity - offset);
+        std::memcpy(ring + offset, data, first);
+        std::memcpy(ring, (char const *) data + first, size - first);
+    }
+
+    /*
+     * Copy bytes out of the ring from the given stream position
+     */
+    inline void ring_read(char const *ring, uint64_t capacity, uint64_t position, void *data, std::size_t size) {
+        auto offset = (std::size_t) (position % capacity);
+        std::size_t first = std::min<std::size_t>(size, capacity - offset);
+        std::memcpy(data, ring + offset, first);
+        std::memcpy((char *) data + first, ring, size - first);
+    }
+}
+
+/*
+ * Observer that publishes the changes of every time step to the shared memory ring
+ */
+class live_stream_writer : public co2_observer {
+public:
+    /*
+     * name: name of the shared memory segment (e.g. "/co2_live")
+     * capacity: bytes of the ring; it is raised to hold at least two keyframes of the lattice
+     */
+    explicit live_stream_writer(std::string name, std::size_t capacity = 64 << 20) : name(std::move(name)), requested(capacity) {}
+
+    ~live_stream_writer() override {
+        finish(frame_time); //No-op if the simulation already called finish
+        if (segment != nullptr) {
+            munmap(segment, segment_size);
+            shm_unlink(name.c_str()); //A viewer still attached keeps its mapping
+        }
+    }
+
+    void shape(int width, int height, int depth) override {
+        this->width = width;
+        this->height = height;
+        this->depth = depth;
+        has_shape = true;
+    }
+
+    void resume(double time) override {
+        frame_time = time;
+    }
+
+    void initial_state(int x, int y, int z, co2 const &state) override {
+        if (!has_shape) {
+            throw std::logic_error("the live stream needs the shape of the lattice before the states");
+        }
+        if (grid.empty()) {
+            open();
+        }
+        set(x, y, z, state);
+    }
+
+    void state_change(double time, int x, int y, int z, co2 const &state) override {
+        if (segment == nullptr) {
+            return;
+        }
+        if (time != frame_time) {
+            if (!flush()) {
+                merged++;
+                header()->merged_steps.fetch_add(1, std::memory_order_relaxed);
+            }
+            frame_time = time;
+        }
+        set(x, y, z, state);
+    }
+
+    /*
+     * Publish the last changes, waiting up to a second for the viewer since the simulation is over
+     */
+    void finish(double /*time*/) override {
+        if (segment == nullptr || header()->finished.load()) {
+            return;
+        }
+        flush();
+        for (int i = 0; i < 100 && (!dirty_cells.empty() || header()->keyframe_request.load()); i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            flush();
+        }
+        header()->finished.store(1, std::memory_order_release);
+    }
+
+    [[nodiscard]] uint64_t frames() const {
+        return (segment != nullptr)? header()->frames.load() : 0;
+    }
+
+    [[nodiscard]] uint64_t merged_steps() const {
+        return (segment != nullptr)? header()->merged_steps.load() : 0;
+    }
+
+private:
+    co2_live::header *header() const {
+        return (co2_live::header *) segment;
+    }
+
+    char *ring() const {
+        return (char *) segment + sizeof(co2_live::header);
+    }
+
+    /*
+     * Create the shared memory segment, replacing the one of a previous run
+     */
+    void open() {
+        std::size_t cells = (std::size_t) width * height * depth;
+        grid.assign(cells, co2(-1, 0, IMPERMEABLE_STRUCTURE));
+        dirty.assign(cells, 0);
+        std::size_t keyframe = sizeof(co2_live::frame_header) + cells * sizeof(co2_live::cell);
+        capacity = std::max(requested, 2 * keyframe);
+        segment_size = sizeof(co2_live::header) + capacity;
+
+        shm_unlink(name.c_str());
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("cannot create the shared memory segment " + name);
+        }
+        if (ftruncate(fd, (off_t) segment_size) != 0) {
+            close(fd);
+            throw std::runtime_error("cannot size the shared memory segment " + name);
+        }
+        segment = mmap(nullptr, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (segment == MAP_FAILED) {
+            segment = nullptr;
+            throw std::runtime_error("cannot map the shared memory segment " + name);
+        }
+        auto h = new (segment) co2_live::header();
+        std::memcpy(h->magic, co2_live::magic, 4);
+        h->version = co2_live::version;
+        h->width = width;
+        h->height = height;
+        h->depth = depth;
+        h->capacity = capacity;
+        h->keyframe_request.store(1); //The first frame holds the initial states
+    }
+
+    void set(int x, int y, int z, co2 const &state) {
+        if (x < 0 || y < 0 || z < 0 || x >= width || y >= height || z >= depth) {
+            return;
+        }
+        int i = (x * height + y) * depth + z;
+        grid[i] = state;
+        if (!dirty[i]) {
+            dirty[i] = 1;
+            dirty_cells.push_back(i);
+        }
+    }
+
+    /*
+     * Write the pending cells as one frame if it fits, else keep them for the next time step
+     *
+     * return false if the frame did not fit
+     */
+    bool flush() {
+        co2_live::header *h = header();
+        bool keyframe = h->keyframe_request.exchange(0, std::memory_order_acq_rel) != 0;
+        if (!keyframe && dirty_cells.empty()) {
+            return true;
+        }
+        std::size_t cells = keyframe? grid.size() : dirty_cells.size();
+        std::size_t size = sizeof(co2_live::frame_header) + cells * sizeof(co2_live::cell);
+        uint64_t write = h->write.load(std::memory_order_relaxed);
+        uint64_t read = h->read.load(std::memory_order_acquire);
+        if (capacity - (write - read) < size) {
+            if (keyframe) {
+                h->keyframe_request.store(1, std::memory_order_release);
+            }
+            return false;
+        }
+
+        co2_live::frame_header f{(uint32_t) size, keyframe? (uint32_t) 'K' : (uint32_t) 'D', frame_time, (uint32_t) cells, merged};
+        co2_live::ring_write(ring(), capacity, write, &f, sizeof(f));
+        uint64_t position = write + sizeof(f);
+        auto put = [&](int i) {
+            co2_live::cell c{i, grid[i].counter, grid[i].concentration, grid[i].type};
+            co2_live::ring_write(ring(), capacity, position, &c, sizeof(c));
+            position += sizeof(c);
+        };
+        if (keyframe) {
+            for (int i = 0; i < (int) grid.size(); i++) {
+                put(i);
+            }
+        } else {
+            std::sort(dirty_cells.begin(), dirty_cells.end());
+            for (int i : dirty_cells) {
+                put(i);
+            }
+        }
+        for (int i : dirty_cells) {
+            dirty[i] = 0;
+        }
+        dirty_cells.clear();
+        merged = 0;
+        h->write.store(position, std::memory_order_release);
+        h->frames.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    std::string name;
+    std::size_t requested;
+    std::size_t capacity = 0;
+    void *segment = nullptr;
+    std::size_t segment_size = 0;
+    int width = 0;
+    int height = 0;
+    int depth = 1;
+    bool has_shape = false;
+    std::vector<co2> grid; //Last state of every cell
+    std::vector<char> dirty; //Cells changed since the last frame
+    std::vector<int> dirty_cells;
+    uint32_t merged = 0; //Time steps merged into the pending frame
+    double frame_time = 0; //Time of the pending changes, the last time seen
+};
+
+/*
+ * Consumer side of the live stream: attaches to the segment and reads the frames as they come
+ */
+class live_stream_reader {
+public:
+    /*
+     * Attach to the segment of a running simulation and ask for a keyframe
+     */
+    explicit live_stream_reader(std::string const &name) {
+        int fd = shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0) {
+            throw std::runtime_error("no live stream " + name);
+        }
+        struct stat st{};
+        fstat(fd, &st);
+        segment_size = (std::size_t) st.st_size;
+        if (segment_size < sizeof(co2_live::header)) {
+            close(fd);
+            throw std::runtime_error(name + " is not a live stream");
+        }
+        segment = mmap(nullptr, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (segment == MAP_FAILED) {
+            segment = nullptr;
+            throw std::runtime_error("cannot map the live stream " + name);
+        }
+        co2_live::header *h = header();
+        if (std::memcmp(h->magic, co2_live::magic, 4) != 0 || h->version != co2_live::version ||
+                sizeof(co2_live::header) + h->capacity > segment_size) {
+            throw std::runtime_error(name + " is not a live stream");
+        }
+        width = h->width;
+        height = h->height;
+        depth = h->depth;
+        grid.assign((std::size_t) width * height * depth, co2(-1, 0, IMPERMEABLE_STRUCTURE));
+        //Skip what was written before, and start from a keyframe
+        h->read.store(h->write.load(std::memory_order_acquire), std::memory_order_release);
+        h->keyframe_request.store(1, std::memory_order_release);
+    }
+
+    ~live_stream_reader() {
+        if (segment != nullptr) {
+            munmap(segment, segment_size);
+        }
+    }
+
+    live_stream_reader(live_stream_reader const &) = delete;
+    live_stream_reader &operator=(live_stream_reader const &) = delete;
+
+    /*
+     * Read the next frame and apply it to the grid. Deltas before the first keyframe are skipped.
+     *
+     * return false if there is no new frame yet
+     */
+    bool next() {
+        co2_live::header *h = header();
+        while (true) {
+            uint64_t read = h->read.load(std::memory_order_relaxed);
+            if (read == h->write.load(std::memory_order_acquire)) {
+                return false;
+            }
+            co2_live::frame_header f{};
+            co2_live::ring_read(ring(), h->capacity, read, &f, sizeof(f));
+            changed.clear();
+            uint64_t position = read + sizeof(f);
+            for (uint32_t i = 0; i < f.cells; i++) {
+                co2_live::cell c{};
+                co2_live::ring_read(ring(), h->capacity, position, &c, sizeof(c));
+                position += sizeof(c);
+                if (c.index >= 0 && c.index < (int) grid.size()) {
+                    grid[c.index] = co2(c.counter, c.concentration, (CELL_TYPE) c.type);
+                    changed.push_back(c.index);
+                }
+            }
+            h->read.store(read + f.size, std::memory_order_release);
+            keyframe = f.type == 'K';
+            if (!keyframe && !synchronized) {
+                continue;
+            }
+            synchronized = true;
+            frame_time = f.time;
+            merged = f.merged;
+            return true;
+        }
+    }
+
+    /*
+     * return true once the simulation ended and every frame was read
+     */
+    [[nodiscard]] bool finished() const {
+        co2_live::header *h = header();
+        return h->finished.load(std::memory_order_acquire) &&
+               h->read.load(std::memory_order_relaxed) == h->write.load(std::memory_order_acquire);
+    }
+
+    [[nodiscard]] uint64_t merged_steps() const {
+        return header()->merged_steps.load();
+    }
+
+    [[nodiscard]] co2 const &state(int x, int y, int z = 0) const {
+        return grid[((std::size_t) x * height + y) * depth + z];
+    }
+
+    int width = 0;
+    int height = 0;
+    int depth = 1;
+    double frame_time = 0; //Time of the last frame read
+    bool keyframe = false; //True if the last frame read was a keyframe
+    uint32_t merged = 0; //Time steps merged into the last frame
+    std::vector<int> changed; //Cells of the last frame (index (x * height + y) * depth + z)
+
+private:
+    co2_live::header *header() const {
+        return (co2_live::header *) segment;
+    }
+
+    char const *ring() const {
+        return (char const *) segment + sizeof(co2_live::header);
+    }
+
+    void *segment = nullptr;
+    std::size_t segment_size = 0;
+    std::vector<co2> grid;
+    bool synchronized = false;
+};
+
+#endif //CADMIUM_CELLDEVS_CO2_LIVE_STREAM_HPP
@@ -0,0 +1,153 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CADMIUM_CELLDEVS_CO2_NAVIGATION_FIELD_HPP
+#define CADMIUM_CELLDEVS_CO2_NAVIGATION_FIELD_HPP
+
+#include <deque>
+#include <limits>
+#include <utility>
+#include <vector>
+#include "store_layout.hpp"
+
+/*
+ * Distance (in steps) from every walkable cell of the store to the closest goal cell.
+ * Goal cells are the AIR cells next to one of the target cells (e.g. all the FOODS shelves or the exit door).
+ */
+class distance_field {
+public:
+    static constexpr int unreachable = std::numeric_limits<int>::max();
+
+    /*
+     * Breadth-first search from all the goal cells at once
+     */
+    void build(store_layout const &layout, std::vector<std::pair<int,int>> const &targets) {
+        width = layout.get_width();
+        height = layout.get_height();
+        distances.assign(width * height, unreachable);
+        std::deque<std::pair<int,int>> open;
+        for (auto const &target : targets) {
+            for (auto const &step : steps) {
+                int x = target.first + step.first;
+                int y = target.second + step.second;
+                if (layout.type(x, y) == AIR && distances[x * height + y] != 0) {
+                    distances[x * height + y] = 0;
+                    open.emplace_back(x, y);
+                }
+            }
+        }
+        propagate(layout, open);
+    }
+
+    /*
+     * return the distance to the closest goal, unreachable for obstacles and isolated cells
+     */
+    [[nodiscard]] int distance(int x, int y) const {
+        if (x < 0 || y < 0 || x >= width || y >= height) {
+            return unreachable;
+        }
+        return distances[x * height + y];
+    }
+
+    static constexpr std::pair<int,int> steps[4] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+
+private:
+    void propagate(store_layout const &layout, std::deque<std::pair<int,int>> &open) {
+        while (!open.empty()) {
+            auto current = open.front();
+            open.pop_front();
+            int next = distances[current.first * height + current.second] + 1;
+            for (auto const &step : steps) {
+                int x = current.first + step.first;
+                int y = current.second + step.second;
+                if (layout.type(x, y) == AIR && next < distances[x * height + y]) {
+                    distances[x * height + y] = next;
+                    open.emplace_back(x, y);
+                }
+            }
+        }
+    }
+
+    int width = 0;
+    int height = 0;
+    std::vector<int> distances;
+};
+
+/*
+ * One distance field per shopping area (DAILYUSE, FOODS, DRINKS) plus one for the closest exit.
+ * The goal of a field is every shelf of the area, so it leads a shopper to the closest shelf of its area, not to a given one.
+ * The fields are built once, the first time they are needed (the layout of the store does not change during a run).
+ */
+class navigation_fields {
+public:
+    enum destination {TO_DAILYUSE=0, TO_FOODS=1, TO_DRINKS=2, TO_EXIT=3};
+
+    /*
+     * Build the fields if they were not built yet for this layout size and these exits
+     */
+    void update(store_layout const &layout, std::vector<std::pair<int,int>> const &exits) {
+        if (built && exits == built_exits && layout.get_width() == width && layout.get_height() == height) {
+            return;
+        }
+        for (int i = 0; i < 4; i++) {
+            rebuild(layout, (destination) i, exits);
+        }
+        built = true;
+        built_exits = exits;
+        width = layout.get_width();
+        height = layout.get_height();
+    }
+
+    [[nodiscard]] distance_field const &field(destination to) const {
+        return fields[to];
+    }
+
+    static destination zone_destination(CELL_TYPE type) {
+        switch (type) {
+            case DAILYUSE: return TO_DAILYUSE;
+            case FOODS: return TO_FOODS;
+            default: return TO_DRINKS;
+        }
+    }
+
+private:
+    void rebuild(store_layout const &layout, destination to, std::vector<std::pair<int,int>> const &exits) {
+        switch (to) {
+            case TO_DAILYUSE: fields[to].build(layout, layout.zone(DAILYUSE)); break;
+            case TO_FOODS: fields[to].build(layout, layout.zone(FOODS)); break;
+            case TO_DRINKS: fields[to].build(layout, layout.zone(DRINKS)); break;
+            default: fields[to].build(layout, exits); break;
+        }
+    }
+
+    distance_field fields[4];
+    bool built = false;
+    std::vector<std::pair<int,int>> built_exits;
+    int width = 0;
+    int height = 0;
+};
+
+#endif //CADMIUM_CELLDEVS_CO2_NAVIGATION_FIELD_HPP
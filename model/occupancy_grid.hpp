@@ -0,0 +1,157 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CADMIUM_CELLDEVS_CO2_OCCUPANCY_GRID_HPP
+#define CADMIUM_CELLDEVS_CO2_OCCUPANCY_GRID_HPP
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// Information of one CO2_Source (shopper)
+struct shopper_record {
+    int area; //Area to go (1:DAILYUSE, 2:FOODS, 3:DRINKS)
+    int id; //Student ID
+    char state; //+:Joining; -:Leaving
+    std::pair<int,int> location; //Current position, (-1,-1) once the shopper left the room
+    int stay; //Time steps to stay at the area before leaving
+    int dwell; //Time steps spent at the area
+    int blocked; //Time steps waiting for a free cell
+    std::pair<int,int> previous; //Position before the last movement
+    shopper_record(int i_area, int i_id, char i_state, std::pair<int,int> i_location, int i_stay) :
+            area(i_area), id(i_id), state(i_state), location(i_location), stay(i_stay), dwell(0), blocked(0),
+            previous(i_location) {}
+};
+
+/*
+ * Dense index of the shoppers, keyed by cell position: the number of shoppers standing on every cell.
+ * Cells register their position with reserve() when they are built, so the index always covers the whole lattice
+ * (the engines reserve the whole lattice first, so that the index is allocated once).
+ * Positions outside of the lattice (e.g. (-1,-1) for shoppers that already left) are never stored.
+ */
+class occupancy_grid {
+public:
+    /*
+     * Make sure the grid covers the given position
+     */
+    void reserve(int x, int y) {
+        if (x < 0 || y < 0 || (x < width && y < height)) {
+            return;
+        }
+        int new_width = std::max(width, x + 1);
+        int new_height = std::max(height, y + 1);
+        std::vector<int> new_occupants(new_width * new_height, 0);
+        for (int i = 0; i < width; i++) {
+            for (int j = 0; j < height; j++) {
+                new_occupants[i * new_height + j] = occupants[i * height + j];
+            }
+        }
+        occupants = std::move(new_occupants);
+        width = new_width;
+        height = new_height;
+    }
+
+    /*
+     * Register a new shopper at the given location
+     *
+     * return: the ID of the new shopper
+     */
+    int add_shopper(int area, char state, std::pair<int,int> location, int stay) {
+        int id = (int) shoppers.size();
+        shoppers.emplace_back(area, id, state, location, stay);
+        int idx = index(location.first, location.second);
+        if (idx >= 0) {
+            occupants[idx]++;
+        }
+        return id;
+    }
+
+    /*
+     * Register a shopper of a checkpoint. The shoppers must be restored in ID order.
+     */
+    void restore_shopper(shopper_record const &record) {
+        if (record.id != (int) shoppers.size()) {
+            throw std::invalid_argument("shoppers must be restored in ID order");
+        }
+        shoppers.push_back(record);
+        int idx = index(record.location.first, record.location.second);
+        if (idx >= 0) {
+            occupants[idx]++;
+        }
+    }
+
+    /*
+     * Move a shopper to a new location. (-1,-1) removes it from the floor.
+     */
+    void move_shopper(int id, std::pair<int,int> location) {
+        shopper_record &shopper = shoppers[id];
+        int from = index(shopper.location.first, shopper.location.second);
+        if (from >= 0) {
+            occupants[from]--;
+        }
+        int to = index(location.first, location.second);
+        if (to >= 0) {
+            occupants[to]++;
+        }
+        shopper.location = location;
+    }
+
+    [[nodiscard]] shopper_record &shopper(int id) {
+        return shoppers[id];
+    }
+
+    [[nodiscard]] shopper_record const &shopper(int id) const {
+        return shoppers[id];
+    }
+
+    /*
+     * return true if at least one shopper is at the given position
+     */
+    [[nodiscard]] bool occupied(int x, int y) const {
+        int idx = index(x, y);
+        return idx >= 0 && occupants[idx] > 0;
+    }
+
+    [[nodiscard]] int size() const {
+        return (int) shoppers.size();
+    }
+
+private:
+    [[nodiscard]] int index(int x, int y) const {
+        if (x < 0 || y < 0 || x >= width || y >= height) {
+            return -1;
+        }
+        return x * height + y;
+    }
+
+    int width = 0;
+    int height = 0;
+    std::vector<shopper_record> shoppers; //All the shoppers generated, indexed by ID
+    std::vector<int> occupants; //Number of shoppers at each position
+};
+
+#endif //CADMIUM_CELLDEVS_CO2_OCCUPANCY_GRID_HPP
@@ -0,0 +1,75 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CADMIUM_CELLDEVS_CO2_RANDOM_STREAM_HPP
+#define CADMIUM_CELLDEVS_CO2_RANDOM_STREAM_HPP
+
+#include <cstdint>
+
+/*
+ * Counter-based random numbers (SplitMix64).
+ * A stream is identified by the seed and a key (e.g. a shopper id), and every draw is a hash of the stream and a
+ * counter (e.g. the time step and the number of the draw). Draws do not depend on how many numbers were drawn
+ * before or by whom, so the results do not change with the evaluation order of the cells or the number of threads.
+ */
+class random_stream {
+public:
+    random_stream(uint64_t seed, uint64_t key) : stream(mix(mix(seed) ^ (key * golden))) {}
+
+    /*
+     * return: 64 random bits for the given counter
+     */
+    [[nodiscard]] uint64_t bits(uint64_t counter, uint64_t draw = 0) const {
+        return mix(stream ^ mix(counter * golden + draw));
+    }
+
+    /*
+     * return: a random integer in [0, n)
+     */
+    [[nodiscard]] int uniform(int n, uint64_t counter, uint64_t draw = 0) const {
+        return (int) (((bits(counter, draw) >> 32) * (uint64_t) n) >> 32);
+    }
+
+    /*
+     * return: a random real in (0, 1]
+     */
+    [[nodiscard]] double real(uint64_t counter, uint64_t draw = 0) const {
+        return (double) ((bits(counter, draw) >> 11) + 1) * 0x1.0p-53;
+    }
+
+    static uint64_t mix(uint64_t z) {
+        z += golden;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+private:
+    static constexpr uint64_t golden = 0x9e3779b97f4a7c15ULL;
+    uint64_t stream;
+};
+
+#endif //CADMIUM_CELLDEVS_CO2_RANDOM_STREAM_HPP
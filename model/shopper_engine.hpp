@@ -0,0 +1,475 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CADMIUM_CELLDEVS_CO2_SHOPPER_ENGINE_HPP
+#define CADMIUM_CELLDEVS_CO2_SHOPPER_ENGINE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include "arrival_process.hpp"
+#include "co2_checkpoint.hpp"
+#include "co2_profile.hpp"
+#include "co2_state.hpp"
+#include "navigation_field.hpp"
+#include "occupancy_grid.hpp"
+#include "random_stream.hpp"
+#include "store_layout.hpp"
+
+/*
+ * Shopper (CO2_Source) agents of the store.
+ * All the agents are updated in one batch per simulation step: the first cell evaluated at a new time triggers the
+ * movement phase, and then every cell only checks the occupancy of its own position to switch between AIR and CO2_SOURCE.
+ * Shoppers follow the gradient of precomputed distance fields (see navigation_field.hpp). A shopper heads for the closest
+ * shelf cell of its area, not for an assigned shelf as in the original model (shopper n went to the (n mod shelves)-th cell).
+ *
+ * Movement route:
+ * - enter the room one by one
+ * - walk to the area according to things they want to buy
+ * - stay at the location for a while
+ * - walk to the exit, then leave the room.
+ *
+ * By default a shopper comes in through the entrance every generate_count steps. With an arrival process
+ * (see arrival_process.hpp) the shoppers arrive at the times drawn from its rate profile, through its entrances,
+ * and leave through the closest of its checkouts; the engines ask next_arrival() when to wake up the entrances.
+ */
+class shopper_engine {
+public:
+    std::pair<int,int> entrance = {23, 5}; //Cell where the shoppers appear
+    std::pair<int,int> exit = {24, 5}; //Destination of the shoppers that are leaving
+    int generate_count = 5; //Student generate speed (n steps/student)
+    int patience = 3; //Time steps a blocked shopper waits before stepping aside
+    uint64_t seed = (uint64_t) std::time(nullptr); //Seed of the random numbers (see random_stream.hpp)
+    int total_shoppers = 25; //Total CO2_Source in the model
+    std::optional<arrival_process> arrivals; //Arrivals from the rate profile of the scenario, if any
+
+    /*
+     * Size the indexes of the store for a lattice of the given size before its cells are registered
+     */
+    void reserve(int width, int height) {
+        layout.reserve(width - 1, height - 1);
+        occupancy.reserve(width - 1, height - 1);
+    }
+
+    /*
+     * Register a cell of the lattice
+     */
+    void add_cell(int x, int y, CELL_TYPE type) {
+        layout.set_type(x, y, type);
+        occupancy.reserve(x, y);
+    }
+
+    /*
+     * Run the movement phase if the simulation reached a new time
+     */
+    void advance(double time) {
+        if (started && time <= last_time) {
+            return;
+        }
+        if (!started) {
+            find_entrance();
+            start_arrivals();
+        }
+        started = true;
+        last_time = time;
+        step();
+    }
+
+    /*
+     * return true if a shopper is standing at the given position
+     */
+    [[nodiscard]] bool occupied(int x, int y) const {
+        return occupancy.occupied(x, y);
+    }
+
+    [[nodiscard]] occupancy_grid const &index() const {
+        return occupancy;
+    }
+
+    [[nodiscard]] store_layout const &floor() const {
+        return layout;
+    }
+
+    [[nodiscard]] int generated() const {
+        return studentGenerated;
+    }
+
+    /*
+     * return: the time of the next movement phase with a shopper to let in, infinity if there is none
+     */
+    [[nodiscard]] double next_arrival() const {
+        if (!arrivals || !started) {
+            return std::numeric_limits<double>::infinity();
+        }
+        for (auto const &entrance : arrivals->entrances) {
+            if (entrance.waiting > 0) {
+                return last_time + 1;
+            }
+        }
+        return arrivals->next_time();
+    }
+
+    /*
+     * return true if no shopper is in the store or waiting to come in: the store stays empty until next_arrival()
+     */
+    [[nodiscard]] bool empty() const {
+        if (!started || inside > 0) {
+            return false;
+        }
+        if (!arrivals) {
+            return studentGenerated >= std::min(total_shoppers, layout.zone_cells() / 2);
+        }
+        return std::none_of(arrivals->entrances.begin(), arrivals->entrances.end(),
+                            [](arrival_process::named_cell const &e) { return e.waiting > 0; });
+    }
+
+    /*
+     * Write the state of the shoppers to a checkpoint. The layout is not saved: it comes from the scenario.
+     */
+    void save(checkpoint_writer &out) const {
+        out.integer(entrance.first);
+        out.integer(entrance.second);
+        out.integer(exit.first);
+        out.integer(exit.second);
+        out.integer(generate_count);
+        out.integer(patience);
+        out.integer((int64_t) seed);
+        out.integer(studentGenerated);
+        out.integer(counter);
+        out.integer((int64_t) steps);
+        out.integer(started);
+        out.real(last_time);
+        out.integer(inside);
+        if (started && arrivals) {
+            out.integer(arrivals->arrived());
+            out.real(arrivals->next_time());
+            for (auto const &entrance : arrivals->entrances) {
+                out.integer(entrance.count);
+                out.integer(entrance.waiting);
+            }
+            for (auto const &checkout : arrivals->checkouts) {
+                out.integer(checkout.count);
+            }
+        }
+        out.integer(occupancy.size());
+        for (int id = 0; id < occupancy.size(); id++) {
+            shopper_record const &s = occupancy.shopper(id);
+            out.integer(s.area);
+            out.integer(s.state);
+            out.integer(s.location.first);
+            out.integer(s.location.second);
+            out.integer(s.stay);
+            out.integer(s.dwell);
+            out.integer(s.blocked);
+            out.integer(s.previous.first);
+            out.integer(s.previous.second);
+        }
+    }
+
+    /*
+     * Restore the state of the shoppers of a checkpoint. The cells must be registered and no shopper generated yet.
+     * total_shoppers keeps the value of the scenario, so a checkpoint can be resumed with another configuration.
+     * The arrival process must be the one of the checkpoint.
+     */
+    void load(checkpoint_reader &in) {
+        if (occupancy.size() != 0) {
+            throw std::logic_error("shoppers can only be restored before the simulation starts");
+        }
+        entrance.first = (int) in.integer();
+        entrance.second = (int) in.integer();
+        exit.first = (int) in.integer();
+        exit.second = (int) in.integer();
+        generate_count = (int) in.integer();
+        patience = (int) in.integer();
+        seed = (uint64_t) in.integer();
+        studentGenerated = (int) in.integer();
+        counter = (int) in.integer();
+        steps = (uint64_t) in.integer();
+        started = in.integer() != 0;
+        last_time = in.real();
+        inside = (int) in.integer();
+        if (started) {
+            start_arrivals();
+        }
+        if (started && arrivals) {
+            long arrived = (long) in.integer();
+            arrivals->restore(arrived, in.real());
+            for (auto &entrance : arrivals->entrances) {
+                entrance.count = (long) in.integer();
+                entrance.waiting = (long) in.integer();
+            }
+            for (auto &checkout : arrivals->checkouts) {
+                checkout.count = (long) in.integer();
+            }
+        }
+        auto shoppers = in.integer();
+        for (int id = 0; id < shoppers; id++) {
+            int area = (int) in.integer();
+            char state = (char) in.integer();
+            int x = (int) in.integer();
+            int y = (int) in.integer();
+            shopper_record s(area, id, state, {x, y}, (int) in.integer());
+            s.dwell = (int) in.integer();
+            s.blocked = (int) in.integer();
+            s.previous.first = (int) in.integer();
+            s.previous.second = (int) in.integer();
+            occupancy.restore_shopper(s);
+        }
+    }
+
+private:
+    /*
+     * Complete the arrival process with the door of the store and draw the first arrival
+     */
+    void start_arrivals() {
+        exits = {exit};
+        if (!arrivals) {
+            return;
+        }
+        if (arrivals->entrances.empty()) {
+            arrivals->entrances.push_back({"door", entrance});
+        }
+        if (arrivals->checkouts.empty()) {
+            arrivals->checkouts.push_back({"door", exit});
+        }
+        for (auto const &e : arrivals->entrances) {
+            if (layout.type(e.cell.first, e.cell.second) != AIR) {
+                throw std::invalid_argument("entrance " + e.name + " is not an AIR cell");
+            }
+        }
+        exits.clear();
+        for (auto const &checkout : arrivals->checkouts) {
+            exits.push_back(checkout.cell);
+        }
+        if (arrivals->capacity < 0) {
+            arrivals->capacity = layout.zone_cells() / 2;
+        }
+        arrivals->start(seed, total_shoppers);
+    }
+
+    /*
+     * Stores whose exit is not a door (e.g. generated layouts) use the first door of the layout as exit
+     * and the AIR cell next to it as entrance
+     */
+    void find_entrance() {
+        if (layout.type(exit.first, exit.second) == DOOR) {
+            return;
+        }
+        for (int x = 0; x < layout.get_width(); x++) {
+            for (int y = 0; y < layout.get_height(); y++) {
+                if (layout.type(x, y) != DOOR) {
+                    continue;
+                }
+                for (auto const &step : distance_field::steps) {
+                    if (layout.type(x + step.first, y + step.second) == AIR) {
+                        exit = {x, y};
+                        entrance = {x + step.first, y + step.second};
+                        return;
+                    }
+                }
+            }
+        }
+    }
+
+    /*
+     * Move every shopper on the floor, then let a new one in
+     */
+    void step() {
+        CO2_PROFILE_TIME(movement);
+        {
+            CO2_PROFILE_TIME(navigation);
+            navigation.update(layout, exits);
+        }
+        {
+            CO2_PROFILE_TIME(routes);
+            for (int id = 0; id < occupancy.size(); id++) {
+                shopper_record &student = occupancy.shopper(id);
+                if (student.location.first == -1 && student.location.second == -1) {
+                    continue;
+                }
+                std::pair<int,int> nextLocation = setNextRoute(student);
+                if (nextLocation != student.location) {
+                    student.previous = student.location;
+                }
+                if (nextLocation.first == -1 && nextLocation.second == -1) {
+                    CO2_PROFILE_COUNT(exits);
+                    leave(student.location);
+                }
+                occupancy.move_shopper(id, nextLocation);
+            }
+        }
+
+        if (arrivals) {
+            //Queue the arrivals due, then let in one shopper per free entrance while the store is not full
+            while (arrivals->next_time() <= last_time) {
+                arrivals->arrive().waiting++;
+            }
+            for (auto &e : arrivals->entrances) {
+                if (e.waiting > 0 && inside < arrivals->capacity && !occupancy.occupied(e.cell.first, e.cell.second)) {
+                    spawn(e.cell);
+                    e.waiting--;
+                    e.count++;
+                }
+            }
+        } else if (counter == 0 && studentGenerated < total_shoppers && studentGenerated < layout.zone_cells()/2) {
+            spawn(entrance);
+        }
+        counter = (counter + 1) % generate_count;
+        steps++;
+    }
+
+    /*
+     * Let a new shopper in at the given cell
+     */
+    void spawn(std::pair<int,int> cell) {
+        //Area and stay of the new shopper, drawn from its own stream
+        random_stream random(seed, studentGenerated);
+        occupancy.add_shopper(random.uniform(3, steps, 0) + 1, '+', cell, random.uniform(60, steps, 1) + 60);
+        studentGenerated++;
+        inside++;
+        CO2_PROFILE_COUNT(spawns);
+    }
+
+    /*
+     * Count a shopper leaving the store from the given cell at the checkout next to it
+     */
+    void leave(std::pair<int,int> location) {
+        inside--;
+        if (!arrivals) {
+            return;
+        }
+        for (auto &checkout : arrivals->checkouts) {
+            if (std::abs(checkout.cell.first - location.first) + std::abs(checkout.cell.second - location.second) <= 1) {
+                checkout.count++;
+                return;
+            }
+        }
+    }
+
+    /*
+     * Calculate the position after the movement
+     *
+     * return: nextLocation, (-1,-1) if the shopper leaves the room
+     */
+    [[nodiscard]] std::pair<int,int> setNextRoute(shopper_record &student) const {
+        std::pair<int,int> location = student.location;
+        if (student.state == '+') {
+            auto const &field = navigation.field(navigation_fields::zone_destination(area_type(student.area)));
+            int distance = field.distance(location.first, location.second);
+            if (distance == distance_field::unreachable) { //Nothing to buy from here
+                student.state = '-';
+            } else if (distance == 0) { //Stay at the area for a while
+                student.dwell++;
+                if (student.dwell >= student.stay) {
+                    student.state = '-';
+                }
+                return location;
+            } else {
+                return downhill(student, field);
+            }
+        }
+        auto const &field = navigation.field(navigation_fields::TO_EXIT);
+        if (field.distance(location.first, location.second) == 0) {
+            return {-1, -1};
+        }
+        return downhill(student, field);
+    }
+
+    static CELL_TYPE area_type(int area) {
+        switch (area) {
+            case 1: return DAILYUSE;
+            case 2: return FOODS;
+            default: return DRINKS;
+        }
+    }
+
+    /*
+     * Step to the free neighbour closest to the goal. If all the closer cells are taken, side-step to a free cell
+     * at the same distance (but not back) or wait. After waiting too long, step to any free cell to clear the way.
+     *
+     * return: the next location
+     */
+    [[nodiscard]] std::pair<int,int> downhill(shopper_record &student, distance_field const &field) const {
+        std::pair<int,int> location = student.location;
+        int distance = field.distance(location.first, location.second);
+        std::pair<int,int> best = location;
+        int best_distance = distance;
+        std::pair<int,int> side = location;
+        std::pair<int,int> away = location;
+        for (auto const &step : distance_field::steps) {
+            std::pair<int,int> next = {location.first + step.first, location.second + step.second};
+            int d = field.distance(next.first, next.second);
+            if (d == distance_field::unreachable || !moveCheck(next.first, next.second)) {
+                continue;
+            }
+            if (d < best_distance) {
+                best = next;
+                best_distance = d;
+            } else if (d == distance && side == location && next != student.previous) {
+                side = next;
+            } else if (away == location) {
+                away = next;
+            }
+        }
+        if (best == location && side == location) {
+            CO2_PROFILE_COUNT(blocked_moves);
+            if (++student.blocked <= patience) {
+                return location;
+            }
+            side = away;
+        }
+        student.blocked = 0;
+        return (best != location)? best : side;
+    }
+
+    /*
+     * Check if the next location is free AIR
+     *
+     * return true if it's available to move
+     */
+    [[nodiscard]] bool moveCheck(int xNext,int yNext) const {
+        CO2_PROFILE_COUNT(move_checks);
+        return layout.type(xNext, yNext) == AIR && !occupancy.occupied(xNext, yNext);
+    }
+
+    store_layout layout;
+    navigation_fields navigation;
+    occupancy_grid occupancy;
+    int studentGenerated = 0; //Record the number of students the already generated
+    int counter = 0; //counter for studentGenerated
+    uint64_t steps = 0; //Movement phases run so far
+    int inside = 0; //Shoppers in the store
+    std::vector<std::pair<int,int>> exits; //Cells the shoppers leave through
+    bool started = false;
+    double last_time = 0;
+};
+
+#endif //CADMIUM_CELLDEVS_CO2_SHOPPER_ENGINE_HPP
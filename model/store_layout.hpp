@@ -0,0 +1,129 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CADMIUM_CELLDEVS_CO2_STORE_LAYOUT_HPP
+#define CADMIUM_CELLDEVS_CO2_STORE_LAYOUT_HPP
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "co2_state.hpp"
+
+/*
+ * Static floor plan of the store: the initial type of every cell and the cells of each shopping area.
+ * Cells register themselves once, when they are built; CO2_SOURCE cells are recorded as AIR, the shoppers live in the occupancy_grid.
+ */
+class store_layout {
+public:
+    /*
+     * Make sure the layout covers the given position. The engines reserve the whole lattice before registering its
+     * cells, so that the arrays are allocated once instead of once per new column.
+     */
+    void reserve(int x, int y) {
+        if (x < 0 || y < 0 || (x < width && y < height)) {
+            return;
+        }
+        int new_width = std::max(width, x + 1);
+        int new_height = std::max(height, y + 1);
+        std::vector<CELL_TYPE> new_types(new_width * new_height, IMPERMEABLE_STRUCTURE);
+        for (int i = 0; i < width; i++) {
+            for (int j = 0; j < height; j++) {
+                new_types[i * new_height + j] = types[i * height + j];
+            }
+        }
+        types = std::move(new_types);
+        width = new_width;
+        height = new_height;
+    }
+
+    void set_type(int x, int y, CELL_TYPE type) {
+        if (x < 0 || y < 0) {
+            return;
+        }
+        reserve(x, y);
+        if (type == CO2_SOURCE) {
+            type = AIR;
+        }
+        types[x * height + y] = type;
+        if (is_zone(type)) {
+            zone_list(type).emplace_back(x, y);
+        }
+    }
+
+    /*
+     * return the type of the cell, positions outside of the store are IMPERMEABLE_STRUCTURE
+     */
+    [[nodiscard]] CELL_TYPE type(int x, int y) const {
+        if (!inside(x, y)) {
+            return IMPERMEABLE_STRUCTURE;
+        }
+        return types[x * height + y];
+    }
+
+    [[nodiscard]] bool inside(int x, int y) const {
+        return x >= 0 && y >= 0 && x < width && y < height;
+    }
+
+    /*
+     * Cells of a shopping area (DAILYUSE, FOODS or DRINKS), in the order they were registered
+     */
+    [[nodiscard]] std::vector<std::pair<int,int>> const &zone(CELL_TYPE type) const {
+        switch (type) {
+            case DAILYUSE: return d_areas;
+            case FOODS: return foods;
+            default: return drinks;
+        }
+    }
+
+    [[nodiscard]] int zone_cells() const {
+        return (int) (d_areas.size() + foods.size() + drinks.size());
+    }
+
+    static bool is_zone(CELL_TYPE type) {
+        return type == DAILYUSE || type == FOODS || type == DRINKS;
+    }
+
+    [[nodiscard]] int get_width() const { return width; }
+    [[nodiscard]] int get_height() const { return height; }
+
+private:
+    std::vector<std::pair<int,int>> &zone_list(CELL_TYPE type) {
+        switch (type) {
+            case DAILYUSE: return d_areas;
+            case FOODS: return foods;
+            default: return drinks;
+        }
+    }
+
+    int width = 0;
+    int height = 0;
+    std::vector<CELL_TYPE> types;
+    std::vector<std::pair<int,int>> d_areas; //Workstations <xPosition,yPosition>
+    std::vector<std::pair<int,int>> foods;
+    std::vector<std::pair<int,int>> drinks;
+};
+
+#endif //CADMIUM_CELLDEVS_CO2_STORE_LAYOUT_HPP
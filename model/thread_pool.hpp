@@ -0,0 +1,136 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CADMIUM_CELLDEVS_CO2_THREAD_POOL_HPP
+#define CADMIUM_CELLDEVS_CO2_THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed set of worker threads that run batches of independent tasks.
+ * The calling thread works on the batch too, so a pool of N threads starts N-1 workers.
+ */
+class thread_pool {
+public:
+    explicit thread_pool(int threads) {
+        for (int i = 1; i < threads; i++) {
+            workers.emplace_back([this]() { work(); });
+        }
+    }
+
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &worker : workers) {
+            worker.join();
+        }
+    }
+
+    thread_pool(thread_pool const &) = delete;
+    thread_pool &operator=(thread_pool const &) = delete;
+
+    [[nodiscard]] int size() const {
+        return (int) workers.size() + 1;
+    }
+
+    /*
+     * Run task(0) ... task(tasks - 1) and wait until all of them finished
+     */
+    void run(int tasks, std::function<void(int)> const &task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &task;
+            total = tasks;
+            next = 0;
+            unfinished = tasks;
+            batch++;
+        }
+        wake.notify_all();
+        help();
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [this]() { return unfinished == 0; });
+        job = nullptr;
+    }
+
+private:
+    void work() {
+        long seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this, seen]() { return stopping || batch != seen; });
+                if (stopping) {
+                    return;
+                }
+                seen = batch;
+            }
+            help();
+        }
+    }
+
+    /*
+     * Take tasks of the current batch until there are none left
+     */
+    void help() {
+        while (true) {
+            int task;
+            std::function<void(int)> const *current;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (job == nullptr || next >= total) {
+                    return;
+                }
+                task = next++;
+                current = job;
+            }
+            (*current)(task);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--unfinished == 0) {
+                finished.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    std::function<void(int)> const *job = nullptr;
+    int total = 0;
+    int next = 0;
+    int unfinished = 0;
+    long batch = 0;
+    bool stopping = false;
+};
+
+#endif //CADMIUM_CELLDEVS_CO2_THREAD_POOL_HPP
@@ -0,0 +1,112 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CADMIUM_CELLDEVS_CO2_VARINT_HPP
+#define CADMIUM_CELLDEVS_CO2_VARINT_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+/*
+ * Little endian binary encoding shared by the state logs and the checkpoints:
+ * LEB128 varints, zigzag encoded signed varints, raw doubles and fixed 64 bit integers.
+ */
+namespace co2_binary {
+    inline void put_varint(std::string &out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back((char) (value | 0x80));
+            value >>= 7;
+        }
+        out.push_back((char) value);
+    }
+
+    inline void put_signed(std::string &out, int64_t value) {
+        put_varint(out, ((uint64_t) value << 1) ^ (uint64_t) (value >> 63));
+    }
+
+    inline void put_double(std::string &out, double value) {
+        char bytes[8];
+        std::memcpy(bytes, &value, 8);
+        out.append(bytes, 8);
+    }
+
+    inline void put_u64(std::string &out, uint64_t value) {
+        for (int i = 0; i < 8; i++) {
+            out.push_back((char) (value >> (8 * i)));
+        }
+    }
+
+    /*
+     * Read cursor over a buffer
+     */
+    struct cursor {
+        char const *data;
+        std::size_t size;
+        std::size_t pos = 0;
+
+        uint64_t varint() {
+            uint64_t value = 0;
+            for (int shift = 0; pos < size && shift < 64; shift += 7) {
+                auto byte = (uint8_t) data[pos++];
+                value |= (uint64_t) (byte & 0x7f) << shift;
+                if ((byte & 0x80) == 0) {
+                    return value;
+                }
+            }
+            throw std::runtime_error("truncated varint");
+        }
+
+        int64_t signed_varint() {
+            uint64_t value = varint();
+            return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+        }
+
+        double real() {
+            if (pos + 8 > size) {
+                throw std::runtime_error("truncated double");
+            }
+            double value;
+            std::memcpy(&value, data + pos, 8);
+            pos += 8;
+            return value;
+        }
+
+        uint64_t u64() {
+            if (pos + 8 > size) {
+                throw std::runtime_error("truncated integer");
+            }
+            uint64_t value = 0;
+            for (int i = 0; i < 8; i++) {
+                value |= (uint64_t) (uint8_t) data[pos++] << (8 * i);
+            }
+            return value;
+        }
+    };
+}
+
+#endif //CADMIUM_CELLDEVS_CO2_VARINT_HPP
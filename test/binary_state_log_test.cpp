@@ -0,0 +1,114 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#define BOOST_TEST_MODULE binary_state_log
+#include <boost/test/unit_test.hpp>
+#include <cstdio>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include "../model/binary_state_log.hpp"
+#include "../model/co2_stencil.hpp"
+#include "co2_test_observer.hpp"
+
+namespace {
+    /*
+     * Log config/grocery.json (seed 1) to a binary state log, with a small keyframe interval so that seek has
+     * several keyframes to choose from
+     */
+    std::string write_log(std::string const &name) {
+        std::string file_path = (std::filesystem::temp_directory_path() / name).string();
+        co2_scenario scenario = co2_scenario::from_file("config/grocery.json");
+        co2_stencil stencil(scenario);
+        stencil.agents().seed = 1;
+        binary_state_writer log(file_path, 20);
+        stencil.run_until(501, &log);
+        log.finish(501);
+        return file_path;
+    }
+
+    /*
+     * State of every cell of the reader's grid, in the text format of results/state.txt
+     */
+    std::string grid_text(binary_state_reader const &log) {
+        std::ostringstream out;
+        for (int x = 0; x < log.width; x++) {
+            for (int y = 0; y < log.height; y++) {
+                text_state_log::write(out, x, y, 0, false, log.state(x, y));
+            }
+        }
+        return out.str();
+    }
+}
+
+/*
+ * Replaying the log frame by frame gives the reference states of grocery_reference_test.cpp
+ */
+BOOST_AUTO_TEST_CASE(replayed_log_reproduces_the_reference) {
+    std::string file_path = write_log("binary_state_log_replay.bin");
+    binary_state_reader log(file_path);
+    std::remove(file_path.c_str());
+    BOOST_TEST(log.width == 25);
+    BOOST_TEST(log.height == 30);
+    BOOST_TEST(log.depth == 1);
+
+    std::ostringstream snapshots;
+    for (double time : {250.0, 500.0}) {
+        while (log.next_time() <= time) {
+            log.next();
+        }
+        snapshots << time << "\n" << grid_text(log);
+    }
+    BOOST_TEST(snapshots.str() == read_file("test/data/grocery_json_seed1.txt"));
+}
+
+BOOST_AUTO_TEST_CASE(seek_gives_the_state_of_a_sequential_read) {
+    std::string file_path = write_log("binary_state_log_seek.bin");
+    binary_state_reader sequential(file_path);
+    binary_state_reader seeking(file_path);
+    std::remove(file_path.c_str());
+    for (double time : {0.0, 37.0, 250.0, 499.0}) {
+        while (sequential.next_time() <= time) {
+            sequential.next();
+        }
+        seeking.seek(time);
+        while (seeking.next_time() <= time) {
+            seeking.next();
+        }
+        BOOST_TEST(grid_text(sequential) == grid_text(seeking));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(other_files_are_rejected) {
+    std::string file_path = (std::filesystem::temp_directory_path() / "binary_state_log_other.bin").string();
+    {
+        std::ofstream out(file_path);
+        out << "0\nState for model (0,0) is <-1,500,-100>\n";
+    }
+    BOOST_CHECK_THROW(binary_state_reader log(file_path), std::runtime_error);
+    std::remove(file_path.c_str());
+}
@@ -0,0 +1,62 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#define BOOST_TEST_MODULE co2_cadmium
+#include <boost/test/unit_test.hpp>
+#include <memory>
+#include <cadmium/modeling/dynamic_coupled.hpp>
+#include <cadmium/engine/pdevs_dynamic_runner.hpp>
+#include <cadmium/logger/common_loggers.hpp>
+#include "../model/co2_coupled.hpp"
+#include "../model/co2_stencil.hpp"
+#include "co2_test_observer.hpp"
+
+using TIME = double;
+
+/*
+ * The Cadmium cells on config/grocery.json with seed 1 must give the states of test/data/grocery_json_seed1.txt,
+ * like the other engines (see grocery_reference_test.cpp). The reference was recorded with the stencil engine, so this
+ * is the check that the Cadmium cells and the stencil engine agree. The test runs from the root of the repository.
+ */
+BOOST_AUTO_TEST_CASE(cadmium_cells_reproduce_the_reference) {
+    co2_scenario scenario = co2_scenario::load_json("config/grocery.json");
+    shoppers.seed = 1;
+    shoppers.reserve(scenario.width, scenario.height);
+    snapshot_observer snapshots({250, 500});
+    observers.add(&snapshots);
+    observers.shape(scenario.width, scenario.height, scenario.depth);
+    walls = lattice_walls(scenario);
+
+    auto model = std::make_shared<co2_coupled<TIME>>("co2_lab");
+    model->add_lattice_json("config/grocery.json");
+    model->couple_cells();
+    std::shared_ptr<cadmium::dynamic::modeling::coupled<TIME>> t = model;
+    cadmium::dynamic::engine::runner<TIME, cadmium::logger::not_logger> r(t, {0});
+    r.run_until(501);
+    observers.finish(501);
+    BOOST_TEST(snapshots.text() == read_file("test/data/grocery_json_seed1.txt"));
+}
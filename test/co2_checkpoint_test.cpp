@@ -0,0 +1,92 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#define BOOST_TEST_MODULE co2_checkpoint
+#include <boost/test/unit_test.hpp>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include "../model/co2_stencil.hpp"
+#include "co2_test_observer.hpp"
+
+/*
+ * A run of config/grocery.json resumed from a checkpoint must continue exactly like the original run
+ * (see grocery_reference_test.cpp for the reference states). The test runs from the root of the repository.
+ */
+BOOST_AUTO_TEST_CASE(resumed_run_continues_like_the_original) {
+    std::string file_path = (std::filesystem::temp_directory_path() / "co2_checkpoint_test.bin").string();
+    co2_scenario scenario = co2_scenario::from_file("config/grocery.json");
+
+    co2_stencil original(scenario);
+    original.agents().seed = 1;
+    original.run_until(200, nullptr);
+    original.save(file_path);
+    change_recorder original_changes;
+    original.run_until(501, &original_changes);
+
+    co2_stencil resumed(scenario);
+    resumed.load(file_path);
+    std::remove(file_path.c_str());
+    BOOST_TEST(resumed.time() == 200);
+    BOOST_TEST(resumed.agents().seed == 1);
+    change_recorder resumed_changes;
+    resumed.run_until(501, &resumed_changes);
+    BOOST_TEST(original_changes.changes.str() == resumed_changes.changes.str());
+    BOOST_TEST(original.computations == resumed.computations);
+    BOOST_TEST(original.state_changes == resumed.state_changes);
+}
+
+BOOST_AUTO_TEST_CASE(resumed_run_reproduces_the_reference) {
+    std::string file_path = (std::filesystem::temp_directory_path() / "co2_checkpoint_reference.bin").string();
+    co2_scenario scenario = co2_scenario::from_file("config/grocery.json");
+    co2_stencil original(scenario);
+    original.agents().seed = 1;
+    original.run_until(100, nullptr);
+    original.save(file_path);
+
+    co2_stencil resumed(scenario);
+    resumed.load(file_path);
+    std::remove(file_path.c_str());
+    snapshot_observer snapshots({250, 500});
+    resumed.run_until(501, &snapshots);
+    snapshots.finish(501);
+    BOOST_TEST(snapshots.text() == read_file("test/data/grocery_json_seed1.txt"));
+}
+
+BOOST_AUTO_TEST_CASE(checkpoint_of_another_layout_is_rejected) {
+    std::string file_path = (std::filesystem::temp_directory_path() / "co2_checkpoint_layout.bin").string();
+    co2_scenario scenario = co2_scenario::from_file("config/grocery.json");
+    co2_stencil original(scenario);
+    original.agents().seed = 1;
+    original.run_until(10, nullptr);
+    original.save(file_path);
+
+    scenario.at(10, 10).type = IMPERMEABLE_STRUCTURE; //An AIR cell of the store
+    co2_stencil other(scenario);
+    BOOST_CHECK_THROW(other.load(file_path), std::invalid_argument);
+    std::remove(file_path.c_str());
+}
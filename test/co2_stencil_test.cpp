@@ -0,0 +1,264 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#define BOOST_TEST_MODULE co2_stencil
+#include <boost/test/unit_test.hpp>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include "../model/co2_metrics.hpp"
+#include "../model/co2_stencil.hpp"
+#include "co2_test_observer.hpp"
+
+/*
+ * A closed box of width x height cells: walls around AIR cells, with one door, one window and one vent in the walls.
+ * Every cell holds 500 ppm, the constant concentration of the doors, windows and vents, so nothing changes.
+ * No shopper comes in.
+ */
+co2_scenario quiet_box(int width, int height) {
+    co2_scenario scenario;
+    scenario.width = width;
+    scenario.height = height;
+    scenario.config = conc(121.6, 500, 500, 500, 5, 0);
+    scenario.cells.assign((std::size_t) width * height, co2(-1, 500, AIR));
+    for (int x = 0; x < width; x++) {
+        for (int y = 0; y < height; y++) {
+            if (x == 0 || y == 0 || x == width - 1 || y == height - 1) {
+                scenario.at(x, y) = co2(-1, 0, IMPERMEABLE_STRUCTURE);
+            }
+        }
+    }
+    scenario.at(0, 2) = co2(-1, 500, DOOR);
+    scenario.at(width - 1, 2) = co2(-1, 500, WINDOW);
+    scenario.at(2, height - 1) = co2(-1, 500, VENTILATION);
+    return scenario;
+}
+
+BOOST_AUTO_TEST_CASE(static_cells_at_their_concentration_are_not_computed) {
+    co2_stencil stencil(quiet_box(6, 6));
+    stencil.run_until(100, nullptr);
+    //Only the 4 x 4 AIR cells are computed, once at time 0
+    BOOST_TEST(stencil.computations == 16);
+}
+
+BOOST_AUTO_TEST_CASE(static_cells_reach_their_concentration) {
+    co2_scenario scenario = quiet_box(6, 6);
+    scenario.at(5, 2) = co2(-1, 450, WINDOW);
+    co2_stencil stencil(scenario);
+    stencil.run_until(1, nullptr);
+    BOOST_TEST(stencil.state(5, 2).concentration == 500);
+    long computations = stencil.computations;
+    //The AIR cells next to the window see its first concentration, the window is not computed again
+    stencil.run_until(2000, nullptr);
+    BOOST_TEST(stencil.state(5, 2).concentration == 500);
+    BOOST_TEST(stencil.computations > computations);
+}
+
+/*
+ * The quiet box of 20 x 12 cells with stale air at 900 ppm, and the window at 400 ppm: the field relaxes towards the
+ * door and the window, and the rounded averages keep it moving for a long time
+ */
+co2_scenario airing_box() {
+    co2_scenario scenario = quiet_box(20, 12);
+    scenario.config.window_conc = 400;
+    scenario.at(19, 2) = co2(-1, 400, WINDOW);
+    for (int x = 1; x < 19; x++) {
+        for (int y = 1; y < 11; y++) {
+            scenario.at(x, y) = co2(-1, 900, AIR);
+        }
+    }
+    return scenario;
+}
+
+// Largest concentration difference between the cells of two runs of the same scenario
+int largest_difference(co2_stencil const &a, co2_stencil const &b) {
+    int res = 0;
+    for (int x = 0; x < a.get_width(); x++) {
+        for (int y = 0; y < a.get_height(); y++) {
+            res = std::max(res, std::abs(a.state(x, y).concentration - b.state(x, y).concentration));
+        }
+    }
+    return res;
+}
+
+BOOST_AUTO_TEST_CASE(fast_forward_follows_the_time_steps) {
+    co2_stencil skipped(airing_box());
+    co2_stencil stepped(airing_box());
+    skipped.set_fast_forward(50);
+    skipped.run_until(60, nullptr);
+    stepped.run_until(60, nullptr);
+    BOOST_TEST(skipped.fast_forwards == 1);
+    //Every time step rounds the averages down, so the time-stepped field loses less than 1 ppm per step
+    BOOST_TEST(largest_difference(skipped, stepped) <= 60);
+
+    //The period after the jump is too short to skip: the cells are computed again from the new field
+    long computations = skipped.computations;
+    co2 middle = skipped.state(10, 6);
+    skipped.run_until(90, nullptr);
+    stepped.run_until(90, nullptr);
+    BOOST_TEST(skipped.fast_forwards == 1);
+    BOOST_TEST(skipped.computations > computations);
+    BOOST_TEST(skipped.state(10, 6).concentration < middle.concentration);
+    BOOST_TEST(largest_difference(skipped, stepped) <= 90);
+}
+
+/*
+ * Run the airing box until 400, fast-forwarding the time steps [100, 300) if fast_forward, and return the mean CO2
+ * of the metrics rows by time
+ */
+std::map<double, double> airing_metrics(bool fast_forward) {
+    std::string file_path = (std::filesystem::temp_directory_path() / "co2_stencil_metrics.csv").string();
+    std::map<double, double> res;
+    {
+        co2_metrics metrics(file_path, 10);
+        co2_stencil stencil(airing_box());
+        stencil.run_until(100, &metrics);
+        stencil.set_fast_forward(fast_forward? 50 : 0);
+        stencil.run_until(300, &metrics);
+        stencil.set_fast_forward(0);
+        stencil.run_until(400, &metrics);
+        metrics.finish(400);
+    }
+    std::ifstream in(file_path);
+    std::string header;
+    std::getline(in, header);
+    double time;
+    double mean;
+    char comma;
+    std::string rest;
+    while (in >> time >> comma >> mean >> rest) {
+        res[time] = mean;
+    }
+    std::remove(file_path.c_str());
+    return res;
+}
+
+BOOST_AUTO_TEST_CASE(fast_forward_writes_no_metrics_for_the_skipped_times) {
+    auto stepped = airing_metrics(false);
+    auto skipped = airing_metrics(true);
+    BOOST_TEST(stepped.size() == 40u);
+    //The rows from 100 to 290 are skipped; the jump ends at 299, so the row of 300 holds the solved field
+    BOOST_TEST(skipped.size() == 20u);
+    for (auto const &row : skipped) {
+        BOOST_TEST_CONTEXT("time " << row.first) {
+            BOOST_TEST((row.first < 100 || row.first >= 300));
+            BOOST_TEST(stepped.count(row.first) == 1u);
+            if (row.first < 100) {
+                BOOST_TEST(row.second == stepped[row.first]);
+            } else {
+                //The time-stepped field loses less than 1 ppm per time step by rounding its averages down
+                BOOST_TEST(std::abs(row.second - stepped[row.first]) <= 200);
+                BOOST_TEST(row.second >= stepped[row.first]);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(fast_forward_to_the_steady_state_leaves_nothing_to_compute) {
+    //The door, the window and the vent are all at 500 ppm, so the box ends at 500 ppm
+    co2_scenario scenario = quiet_box(20, 12);
+    for (int x = 1; x < 19; x++) {
+        for (int y = 1; y < 11; y++) {
+            scenario.at(x, y) = co2(-1, 900, AIR);
+        }
+    }
+    co2_stencil stencil(scenario);
+    stencil.set_fast_forward(50);
+    stencil.run_until(50000, nullptr);
+    BOOST_TEST(stencil.fast_forwards == 1);
+    BOOST_TEST(stencil.state(10, 6).concentration == 500);
+    //Without the fast-forward the time steps find nothing to compute
+    long computations = stencil.computations;
+    stencil.set_fast_forward(0);
+    stencil.run_until(51000, nullptr);
+    BOOST_TEST(stencil.computations == computations);
+}
+
+// Total concentration of the open cells
+long long total_co2(co2_stencil const &stencil) {
+    long long res = 0;
+    for (int x = 0; x < stencil.get_width(); x++) {
+        for (int y = 0; y < stencil.get_height(); y++) {
+            if (stencil.state(x, y).type != IMPERMEABLE_STRUCTURE) {
+                res += stencil.state(x, y).concentration;
+            }
+        }
+    }
+    return res;
+}
+
+adaptive_options coarse_blocks() {
+    adaptive_options options;
+    options.block = 8;
+    options.threshold = 10;
+    return options;
+}
+
+BOOST_AUTO_TEST_CASE(adaptive_run_conserves_the_co2) {
+    //A closed box of 66 x 66 cells at 500 ppm with a corner at 900 ppm: the CO2 can only spread
+    co2_scenario scenario = quiet_box(66, 66);
+    scenario.at(0, 2) = scenario.at(65, 2) = scenario.at(2, 65) = co2(-1, 0, IMPERMEABLE_STRUCTURE);
+    for (int x = 1; x < 7; x++) {
+        for (int y = 1; y < 7; y++) {
+            scenario.at(x, y) = co2(-1, 900, AIR);
+        }
+    }
+    co2_stencil fine(scenario);
+    co2_stencil adaptive(scenario);
+    adaptive.set_adaptive(coarse_blocks());
+    long long initial = total_co2(fine);
+    for (int t = 50; t <= 500; t += 50) {
+        fine.run_until(t, nullptr);
+        adaptive.run_until(t, nullptr);
+        //Only the rounded averages of the fine cells lose CO2, less than 1 ppm per cell apart from the fine run
+        BOOST_TEST(total_co2(adaptive) <= initial);
+        BOOST_TEST(std::abs(total_co2(adaptive) - total_co2(fine)) <= 64 * 64);
+    }
+    BOOST_TEST(adaptive.merges > 0);
+}
+
+BOOST_AUTO_TEST_CASE(adaptive_run_follows_the_fine_run) {
+    //The box of 66 x 66 cells at 500 ppm with the window at 400 ppm
+    co2_scenario scenario = quiet_box(66, 66);
+    scenario.config.window_conc = 400;
+    scenario.at(65, 2) = co2(-1, 400, WINDOW);
+    co2_stencil fine(scenario);
+    co2_stencil adaptive(scenario);
+    adaptive.set_adaptive(coarse_blocks());
+    long long previous = total_co2(adaptive);
+    for (int t = 50; t <= 400; t += 50) {
+        fine.run_until(t, nullptr);
+        adaptive.run_until(t, nullptr);
+        //The coarse cells never round their CO2 down, so the adaptive run relaxes as fast as the fine run at most
+        BOOST_TEST(total_co2(adaptive) < previous);
+        BOOST_TEST(total_co2(adaptive) >= total_co2(fine) - 64 * 64);
+        previous = total_co2(adaptive);
+    }
+    BOOST_TEST(adaptive.merges > 0);
+}
@@ -0,0 +1,143 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef CADMIUM_CELLDEVS_CO2_TEST_OBSERVER_HPP
+#define CADMIUM_CELLDEVS_CO2_TEST_OBSERVER_HPP
+
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "../model/co2_observers.hpp"
+
+/*
+ * Keeps the state of every cell and records snapshots of the grid at the given times, in the text format of
+ * results/state.txt (one line per cell): the snapshot of time T holds the states after every change up to T.
+ * Run the engines until a time after the last snapshot.
+ */
+class snapshot_observer : public co2_observer {
+public:
+    explicit snapshot_observer(std::vector<double> times) : times(std::move(times)) {}
+
+    void shape(int width, int height, int depth) override {
+        this->width = width;
+        this->height = height;
+        this->depth = depth;
+        cells.assign((std::size_t) width * height * depth, co2(-1, 0, IMPERMEABLE_STRUCTURE));
+    }
+
+    void initial_state(int x, int y, int z, co2 const &state) override {
+        cells[index(x, y, z)] = state;
+    }
+
+    void state_change(double time, int x, int y, int z, co2 const &state) override {
+        take_before(time);
+        cells[index(x, y, z)] = state;
+        changes++;
+    }
+
+    void finish(double time) override {
+        take_before(time);
+    }
+
+    /*
+     * return: the snapshots taken, each one starting with its time on its own line
+     */
+    [[nodiscard]] std::string text() const {
+        std::ostringstream out;
+        for (auto const &snapshot : snapshots) {
+            out << snapshot.first << "\n" << snapshot.second;
+        }
+        return out.str();
+    }
+
+    long changes = 0; //State changes notified
+
+private:
+    [[nodiscard]] std::size_t index(int x, int y, int z) const {
+        return ((std::size_t) x * height + y) * depth + z;
+    }
+
+    void take_before(double time) {
+        while (next < times.size() && times[next] < time) {
+            std::ostringstream out;
+            for (int x = 0; x < width; x++) {
+                for (int y = 0; y < height; y++) {
+                    for (int z = 0; z < depth; z++) {
+                        text_state_log::write(out, x, y, z, depth > 1, cells[index(x, y, z)]);
+                    }
+                }
+            }
+            snapshots[times[next]] = out.str();
+            next++;
+        }
+    }
+
+    std::vector<double> times;
+    std::size_t next = 0;
+    int width = 0;
+    int height = 0;
+    int depth = 1;
+    std::vector<co2> cells;
+    std::map<double, std::string> snapshots;
+};
+
+/*
+ * Records every notification, to compare two runs change by change
+ */
+class change_recorder : public co2_observer {
+public:
+    void initial_state(int x, int y, int z, co2 const &state) override {
+        text_state_log::write(initial, x, y, z, true, state);
+    }
+
+    void state_change(double time, int x, int y, int z, co2 const &state) override {
+        changes << time << " ";
+        text_state_log::write(changes, x, y, z, true, state);
+    }
+
+    std::ostringstream initial;
+    std::ostringstream changes;
+};
+
+/*
+ * return: the content of a file of the test data
+ */
+inline std::string read_file(std::string const &file_path) {
+    std::ifstream in(file_path);
+    if (!in) {
+        throw std::runtime_error("cannot open " + file_path);
+    }
+    std::ostringstream content;
+    content << in.rdbuf();
+    return content.str();
+}
+
+#endif //CADMIUM_CELLDEVS_CO2_TEST_OBSERVER_HPP
@@ -0,0 +1,151 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#define BOOST_TEST_MODULE grocery_reference
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <boost/test/unit_test.hpp>
+#include "../model/co2_stencil.hpp"
+#include "../model/co2_volume.hpp"
+#include "co2_test_observer.hpp"
+
+/*
+ * The states of config/grocery.json at times 250 and 500 with seed 1 are kept in test/data/grocery_json_seed1.txt.
+ * They were recorded with the stencil engine: co2_cadmium_test.cpp checks the Cadmium cells against them.
+ * Every engine must reproduce them: the shoppers (occupancy grid, navigation, random streams) and the diffusion.
+ * The tests run from the root of the repository.
+ */
+BOOST_AUTO_TEST_CASE(stencil_engine_reproduces_the_reference) {
+    co2_scenario scenario = co2_scenario::from_file("config/grocery.json");
+    co2_stencil stencil(scenario);
+    stencil.agents().seed = 1;
+    snapshot_observer snapshots({250, 500});
+    stencil.run_until(501, &snapshots);
+    snapshots.finish(501);
+    BOOST_TEST(snapshots.text() == read_file("test/data/grocery_json_seed1.txt"));
+}
+
+BOOST_AUTO_TEST_CASE(stencil_engine_results_do_not_depend_on_the_threads) {
+    //The store repeated 4 x 4 times, so that the time steps have enough active cells to use the thread pool
+    co2_scenario store = co2_scenario::from_file("config/grocery.json");
+    co2_scenario scenario = store;
+    scenario.width *= 4;
+    scenario.height *= 4;
+    scenario.cells.resize((std::size_t) scenario.width * scenario.height);
+    for (int x = 0; x < scenario.width; x++) {
+        for (int y = 0; y < scenario.height; y++) {
+            scenario.at(x, y) = store.at(x % store.width, y % store.height);
+        }
+    }
+    co2_stencil serial(scenario, 1);
+    co2_stencil parallel(scenario, 3);
+    serial.agents().seed = 1;
+    parallel.agents().seed = 1;
+    change_recorder serial_changes;
+    change_recorder parallel_changes;
+    serial.run_until(301, &serial_changes);
+    parallel.run_until(301, &parallel_changes);
+    BOOST_TEST(serial_changes.changes.str() == parallel_changes.changes.str());
+}
+
+BOOST_AUTO_TEST_CASE(volume_engine_reproduces_the_reference) {
+    co2_scenario scenario = co2_scenario::from_file("config/grocery.json");
+    co2_volume volume(scenario);
+    volume.agents().seed = 1;
+    snapshot_observer snapshots({250, 500});
+    volume.run_until(501, &snapshots);
+    snapshots.finish(501);
+    BOOST_TEST(snapshots.text() == read_file("test/data/grocery_json_seed1.txt"));
+}
+
+BOOST_AUTO_TEST_CASE(volume_engine_notifies_the_changes_of_the_stencil_engine) {
+    co2_scenario scenario = co2_scenario::from_file("config/grocery.json");
+    co2_stencil stencil(scenario);
+    co2_volume volume(scenario);
+    stencil.agents().seed = 1;
+    volume.agents().seed = 1;
+    change_recorder stencil_changes;
+    change_recorder volume_changes;
+    stencil.run_until(501, &stencil_changes);
+    volume.run_until(501, &volume_changes);
+    BOOST_TEST(stencil_changes.initial.str() == volume_changes.initial.str());
+    BOOST_TEST(stencil_changes.changes.str() == volume_changes.changes.str());
+}
+
+BOOST_AUTO_TEST_CASE(volume_engine_reproduces_the_reference_from_a_sparse_scenario) {
+    co2_scenario scenario = co2_scenario::from_file("config/grocery.json", true);
+    BOOST_TEST(scenario.cells.empty());
+    co2_volume volume(scenario);
+    volume.agents().seed = 1;
+    snapshot_observer snapshots({250, 500});
+    volume.run_until(501, &snapshots);
+    snapshots.finish(501);
+    BOOST_TEST(snapshots.text() == read_file("test/data/grocery_json_seed1.txt"));
+}
+
+BOOST_AUTO_TEST_CASE(sparse_scenario_holds_the_cells_of_the_dense_scenario) {
+    //A solid block with a few air cells, one of them listed twice (the last state wins)
+    std::string path = (std::filesystem::temp_directory_path() / "co2_sparse_scenario.json").string();
+    co2_scenario store = co2_scenario::from_file("config/grocery.json");
+    json j = store.to_json();
+    j["scenario"]["shape"] = {4, 3, 2};
+    j["scenario"]["default_state"] = co2(-1, 0, IMPERMEABLE_STRUCTURE);
+    j["cells"] = {{{"cell_id", {1, 1, 0}}, {"state", co2(-1, 700, AIR)}},
+                  {{"cell_id", {0, 1, 0}}, {"state", co2(-1, 400, WINDOW)}},
+                  {{"cell_id", {1, 1, 1}}, {"state", co2(-1, 600, AIR)}},
+                  {{"cell_id", {2, 1, 0}}, {"state", co2(-1, 500, AIR)}},
+                  {{"cell_id", {1, 1, 0}}, {"state", co2(-1, 900, AIR)}}};
+    std::ofstream(path) << j;
+    co2_scenario dense = co2_scenario::from_file(path);
+    co2_scenario const sparse = co2_scenario::from_file(path, true);
+    j["cells"].push_back({{"cell_id", {4, 0, 0}}});
+    std::ofstream(path) << j;
+    BOOST_CHECK_THROW(co2_scenario::from_file(path, true), std::out_of_range);
+    std::remove(path.c_str());
+
+    BOOST_TEST(sparse.listed.size() == 4u);
+    for (int x = 0; x < dense.width; x++) {
+        for (int y = 0; y < dense.height; y++) {
+            for (int z = 0; z < dense.depth; z++) {
+                BOOST_TEST(!(sparse.at(x, y, z) != dense.at(x, y, z)));
+            }
+        }
+    }
+    BOOST_TEST(sparse.at(1, 1, 0).concentration == 900);
+
+    co2_volume dense_volume(dense);
+    co2_volume sparse_volume(sparse);
+    BOOST_TEST(sparse_volume.stored_cells() == 4u);
+    change_recorder dense_changes;
+    change_recorder sparse_changes;
+    dense_volume.run_until(20, &dense_changes);
+    sparse_volume.run_until(20, &sparse_changes);
+    BOOST_TEST(dense_changes.initial.str() == sparse_changes.initial.str());
+    BOOST_TEST(dense_changes.changes.str() == sparse_changes.changes.str());
+    BOOST_TEST(!sparse_changes.changes.str().empty());
+}
@@ -0,0 +1,99 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#define BOOST_TEST_MODULE occupancy_grid
+#include <boost/test/unit_test.hpp>
+#include <stdexcept>
+#include <utility>
+#include "../model/occupancy_grid.hpp"
+
+BOOST_AUTO_TEST_CASE(moves_update_the_occupied_cells) {
+    occupancy_grid grid;
+    grid.reserve(4, 3);
+    int id = grid.add_shopper(1, '+', {2, 1}, 60);
+    BOOST_TEST(grid.occupied(2, 1));
+    BOOST_TEST(!grid.occupied(2, 2));
+
+    grid.move_shopper(id, {2, 2});
+    BOOST_TEST(!grid.occupied(2, 1));
+    BOOST_TEST(grid.occupied(2, 2));
+    BOOST_TEST((grid.shopper(id).location == std::make_pair(2, 2)));
+
+    //A shopper that left the room is no longer on the floor
+    grid.move_shopper(id, {-1, -1});
+    BOOST_TEST(!grid.occupied(2, 2));
+    BOOST_TEST(!grid.occupied(-1, -1));
+    BOOST_TEST(grid.size() == 1);
+}
+
+BOOST_AUTO_TEST_CASE(a_cell_stays_occupied_until_its_last_shopper_leaves) {
+    occupancy_grid grid;
+    grid.reserve(3, 3);
+    int first = grid.add_shopper(1, '+', {1, 1}, 60);
+    int second = grid.add_shopper(2, '+', {1, 1}, 70);
+    grid.move_shopper(first, {1, 2});
+    BOOST_TEST(grid.occupied(1, 1));
+    grid.move_shopper(second, {0, 1});
+    BOOST_TEST(!grid.occupied(1, 1));
+}
+
+BOOST_AUTO_TEST_CASE(shoppers_out_of_the_lattice_are_not_on_the_floor) {
+    occupancy_grid grid;
+    grid.reserve(2, 2);
+    //A shopper registered outside of the lattice (e.g. waiting at the door) occupies no cell until it comes in
+    int id = grid.add_shopper(1, '+', {-1, -1}, 60);
+    int other = grid.add_shopper(2, '+', {3, 1}, 60);
+    for (int x = -1; x <= 3; x++) {
+        for (int y = -1; y <= 3; y++) {
+            BOOST_TEST(!grid.occupied(x, y));
+        }
+    }
+    grid.move_shopper(id, {0, 2});
+    grid.move_shopper(other, {2, 2});
+    BOOST_TEST(grid.occupied(0, 2));
+    BOOST_TEST(grid.occupied(2, 2));
+    BOOST_TEST((grid.shopper(other).location == std::make_pair(2, 2)));
+    BOOST_TEST(grid.size() == 2);
+}
+
+BOOST_AUTO_TEST_CASE(reserve_keeps_the_shoppers_on_the_floor) {
+    occupancy_grid grid;
+    grid.reserve(1, 1);
+    grid.add_shopper(1, '+', {1, 0}, 60);
+    grid.reserve(5, 7);
+    BOOST_TEST(grid.occupied(1, 0));
+    BOOST_TEST(!grid.occupied(0, 1));
+    BOOST_TEST(!grid.occupied(5, 8));
+}
+
+BOOST_AUTO_TEST_CASE(shoppers_are_restored_in_id_order) {
+    occupancy_grid grid;
+    grid.reserve(3, 3);
+    grid.restore_shopper(shopper_record(1, 0, '+', {1, 1}, 60));
+    BOOST_TEST(grid.occupied(1, 1));
+    BOOST_CHECK_THROW(grid.restore_shopper(shopper_record(1, 5, '+', {1, 2}, 60)), std::invalid_argument);
+}
@@ -0,0 +1,261 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Throughput benchmark: runs every scenario in its own process and reports the state changes per second,
+ * the wall time per simulated second, the peak RSS and the size of the state log, as CSV or JSON.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <boost/program_options.hpp>
+#include <cadmium/modeling/dynamic_coupled.hpp>
+#include <cadmium/engine/pdevs_dynamic_runner.hpp>
+#include <cadmium/logger/common_loggers.hpp>
+#include "../model/co2_coupled.hpp"
+#include "../model/co2_stencil.hpp"
+#include "../model/co2_volume.hpp"
+#include "../model/binary_state_log.hpp"
+
+using namespace std;
+
+using TIME = double;
+
+struct bench_options {
+    std::string engine;
+    double sim_time;
+    int threads;
+    std::string log;
+    std::optional<uint64_t> seed;
+};
+
+// Counts the cells and their state changes
+class change_counter : public co2_observer {
+public:
+    void initial_state(int /*x*/, int /*y*/, int /*z*/, co2 const &/*state*/) override {
+        cells++;
+    }
+
+    void state_change(double /*time*/, int /*x*/, int /*y*/, int /*z*/, co2 const &/*state*/) override {
+        changes++;
+    }
+
+    long cells = 0;
+    long changes = 0;
+};
+
+/*
+ * Run one scenario in the current process
+ *
+ * return: "cells,events,wall_seconds,log_bytes"
+ */
+std::string run(std::string const &scenario_path, bench_options const &o) {
+    change_counter counter;
+    observers.add(&counter);
+    std::string log_path = "results/bench_state." + std::string(o.log == "binary"? "bin" : "txt");
+    std::unique_ptr<binary_state_writer> binary_log;
+    std::unique_ptr<ofstream> text_out;
+    std::unique_ptr<text_state_log> text_log;
+    if (o.log == "binary") {
+        binary_log = std::make_unique<binary_state_writer>(log_path);
+        observers.add(binary_log.get());
+    } else if (o.log == "text") {
+        text_out = std::make_unique<ofstream>(log_path);
+        text_log = std::make_unique<text_state_log>(*text_out);
+        observers.add(text_log.get());
+    }
+
+    auto start = chrono::steady_clock::now();
+    if (o.engine == "cadmium") {
+        std::string json_path = scenario_path;
+        co2_scenario scenario = co2_scenario::is_raster(scenario_path)?
+                co2_scenario::load_raster(scenario_path) : co2_scenario::load_json(scenario_path);
+        if (co2_scenario::is_raster(scenario_path)) {
+            json_path = "results/bench_scenario.json";
+            ofstream(json_path) << scenario.to_json();
+        }
+        shoppers.seed = o.seed.value_or(scenario.seed.value_or(1));
+        shoppers.arrivals = scenario.arrivals;
+        observers.shape(scenario.width, scenario.height, scenario.depth);
+        walls = lattice_walls(scenario);
+        auto model = std::make_shared<co2_coupled<TIME>>("co2_lab");
+        model->add_lattice_json(json_path);
+        model->couple_cells();
+        std::shared_ptr<cadmium::dynamic::modeling::coupled<TIME>> t = model;
+        cadmium::dynamic::engine::runner<TIME, cadmium::logger::not_logger> r(t, {0});
+        r.run_until(o.sim_time);
+    } else if (o.engine == "volume") {
+        co2_scenario scenario = co2_scenario::from_file(scenario_path, true);
+        co2_volume volume(scenario);
+        volume.agents().seed = o.seed.value_or(scenario.seed.value_or(1));
+        scenario = co2_scenario();
+        volume.run_until(o.sim_time, &observers);
+    } else {
+        co2_scenario scenario = co2_scenario::from_file(scenario_path);
+        co2_stencil stencil(scenario, o.threads);
+        stencil.agents().seed = o.seed.value_or(scenario.seed.value_or(1));
+        stencil.run_until(o.sim_time, &observers);
+    }
+    observers.finish(o.sim_time);
+    double wall = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    long log_bytes = 0;
+    if (binary_log != nullptr) {
+        log_bytes = (long) binary_log->bytes_written();
+    } else if (text_out != nullptr) {
+        log_bytes = (long) text_out->tellp();
+    }
+    ostringstream res;
+    res << counter.cells << "," << counter.changes << "," << wall << "," << log_bytes;
+    return res.str();
+}
+
+int main(int argc, char ** argv) {
+    namespace po = boost::program_options;
+    po::options_description options("Options");
+    options.add_options()
+        ("help,h", "print this message")
+        ("engine", po::value<std::string>()->default_value("stencil"), "simulation engine: cadmium, stencil or volume")
+        ("time", po::value<double>()->default_value(500), "simulation time of every scenario")
+        ("threads", po::value<int>()->default_value(1), "number of threads of the stencil engine")
+        ("seed", po::value<uint64_t>(), "seed of the random numbers (default: \"seed\" of the scenario, else 1)")
+        ("log", po::value<std::string>()->default_value("binary"), "state log written during the runs: text, binary or none")
+        ("format", po::value<std::string>()->default_value("csv"), "output format: csv or json");
+    po::options_description arguments;
+    arguments.add_options()("scenario", po::value<std::vector<std::string>>());
+    arguments.add(options);
+    po::positional_options_description positional;
+    positional.add("scenario", -1);
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(arguments).positional(positional).run(), vm);
+        po::notify(vm);
+    } catch (po::error const &e) {
+        cout << e.what() << endl;
+        return -1;
+    }
+    if (vm.count("help") || !vm.count("scenario")) {
+        cout << "Program used with wrong parameters. The program must be invoked as follows:";
+        cout << argv[0] << " SCENARIO [SCENARIO...] [OPTIONS]" << endl;
+        cout << options << endl;
+        return -1;
+    }
+    bench_options o{vm["engine"].as<std::string>(), vm["time"].as<double>(), std::max(1, vm["threads"].as<int>()),
+                    vm["log"].as<std::string>(), std::nullopt};
+    if (o.engine != "cadmium" && o.engine != "stencil" && o.engine != "volume") {
+        cout << "Unknown engine: " << o.engine << endl;
+        return -1;
+    }
+    if (o.log != "text" && o.log != "binary" && o.log != "none") {
+        cout << "Unknown state log: " << o.log << endl;
+        return -1;
+    }
+    std::string format = vm["format"].as<std::string>();
+    if (format != "csv" && format != "json") {
+        cout << "Unknown output format: " << format << endl;
+        return -1;
+    }
+    if (vm.count("seed")) {
+        o.seed = vm["seed"].as<uint64_t>();
+    }
+    bool json_format = format == "json";
+
+    json rows = json::array();
+    if (!json_format) {
+        cout << "scenario,engine,threads,sim_time,cells,events,wall_seconds,events_per_second,wall_per_sim_second,"
+                "peak_rss_kb,log_bytes" << endl;
+    }
+    auto const &scenarios = vm["scenario"].as<std::vector<std::string>>();
+    int failures = 0;
+    for (std::size_t i = 0; i < scenarios.size(); i++) {
+        //Every scenario runs in a child process, so that its peak RSS is its own and the model globals start clean
+        int fd[2];
+        if (pipe(fd) != 0) {
+            perror("pipe");
+            return -1;
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(fd[0]);
+            std::string line;
+            try {
+                line = run(scenarios[i], o);
+            } catch (std::exception const &e) {
+                cerr << scenarios[i] << ": " << e.what() << endl;
+                _exit(1);
+            }
+            if (write(fd[1], line.data(), line.size()) != (ssize_t) line.size()) {
+                _exit(1);
+            }
+            _exit(0);
+        }
+        close(fd[1]);
+        std::string line;
+        char buffer[256];
+        ssize_t n;
+        while ((n = read(fd[0], buffer, sizeof(buffer))) > 0) {
+            line.append(buffer, n);
+        }
+        close(fd[0]);
+        int status = 0;
+        struct rusage usage{};
+        wait4(pid, &status, 0, &usage);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || line.empty()) {
+            failures++;
+            continue;
+        }
+
+        long cells, events, log_bytes;
+        double wall;
+        char comma;
+        istringstream fields(line);
+        fields >> cells >> comma >> events >> comma >> wall >> comma >> log_bytes;
+        double events_per_second = (wall > 0)? events / wall : 0;
+        double wall_per_sim_second = wall / o.sim_time;
+        if (json_format) {
+            rows.push_back({{"scenario", scenarios[i]}, {"engine", o.engine}, {"threads", o.threads}, {"sim_time", o.sim_time},
+                        {"cells", cells}, {"events", events}, {"wall_seconds", wall}, {"events_per_second", events_per_second},
+                        {"wall_per_sim_second", wall_per_sim_second}, {"peak_rss_kb", usage.ru_maxrss}, {"log_bytes", log_bytes}});
+        } else {
+            cout << scenarios[i] << "," << o.engine << "," << o.threads << "," << o.sim_time << "," << cells << ","
+                 << events << "," << wall << "," << events_per_second << "," << wall_per_sim_second << ","
+                 << usage.ru_maxrss << "," << log_bytes << endl;
+        }
+    }
+    if (json_format) {
+        cout << rows.dump(4) << endl;
+    }
+    return failures > 0? 1 : 0;
+}
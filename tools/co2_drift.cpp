@@ -0,0 +1,213 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Compares the state log of a quantized run against the log of an exact run
+ * and reports how far the CO2 concentrations drift.
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Reads a state log (results/state.txt) one time step at a time
+ */
+class state_log_reader {
+public:
+    explicit state_log_reader(string const &path) : in(path) {
+        advance_to_time();
+    }
+
+    [[nodiscard]] bool good() const {
+        return has_time;
+    }
+
+    [[nodiscard]] double time() const {
+        return next_time;
+    }
+
+    /*
+     * Apply every state change of the current time step to the concentrations
+     *
+     * return: the number of state changes
+     */
+    long read_step(unordered_map<string,int> &concentrations) {
+        long changes = 0;
+        string line;
+        has_time = false;
+        while (getline(in, line)) {
+            if (parse_time(line)) {
+                has_time = true;
+                break;
+            }
+            string cell;
+            int concentration;
+            if (parse_state(line, cell, concentration)) {
+                concentrations[cell] = concentration;
+                changes++;
+            }
+        }
+        return changes;
+    }
+
+private:
+    void advance_to_time() {
+        string line;
+        while (getline(in, line)) {
+            if (parse_time(line)) {
+                has_time = true;
+                return;
+            }
+        }
+    }
+
+    bool parse_time(string const &line) {
+        char *end;
+        double t = strtod(line.c_str(), &end);
+        if (end == line.c_str()) {
+            return false;
+        }
+        while (*end == ' ' || *end == '\r') {
+            end++;
+        }
+        if (*end != '\0') {
+            return false;
+        }
+        next_time = t;
+        return true;
+    }
+
+    /*
+     * Lines look like "State for model <cell id> is <counter,concentration,type>"
+     */
+    static bool parse_state(string const &line, string &cell, int &concentration) {
+        static const string prefix = "State for model ";
+        size_t is = line.rfind(" is <");
+        if (line.compare(0, prefix.size(), prefix) != 0 || is == string::npos) {
+            return false;
+        }
+        cell = cell_key(line.substr(prefix.size(), is - prefix.size()));
+        size_t comma = line.find(',', is);
+        if (comma == string::npos) {
+            return false;
+        }
+        concentration = atoi(line.c_str() + comma + 1);
+        return true;
+    }
+
+    /*
+     * The coordinates of the cell: the content of the last bracket group of the model ID, or the whole ID
+     */
+    static string cell_key(string const &id) {
+        size_t close = id.find_last_of(")]");
+        if (close != string::npos) {
+            size_t open = id.find_last_of("([", close);
+            if (open != string::npos) {
+                return id.substr(open + 1, close - open - 1);
+            }
+        }
+        return id;
+    }
+
+    ifstream in;
+    bool has_time = false;
+    double next_time = 0;
+};
+
+int main(int argc, char ** argv) {
+    if (argc < 3) {
+        cout << "Program used with wrong parameters. The program must be invoked as follows:";
+        cout << argv[0] << " EXACT_STATE.txt QUANTIZED_STATE.txt [--series]" << endl;
+        return -1;
+    }
+    bool series = argc > 3 && string(argv[3]) == "--series";
+
+    state_log_reader exact(argv[1]);
+    state_log_reader quantized(argv[2]);
+    unordered_map<string,int> exact_conc;
+    unordered_map<string,int> quantized_conc;
+    long exact_changes = 0;
+    long quantized_changes = 0;
+    int max_error = 0;
+    double max_error_time = 0;
+    double sum_squared = 0;
+    long samples = 0;
+
+    if (series) {
+        cout << "time,max_abs_error,mean_abs_error" << endl;
+    }
+    while (exact.good() || quantized.good()) {
+        double t;
+        if (exact.good() && (!quantized.good() || exact.time() <= quantized.time())) {
+            t = exact.time();
+        } else {
+            t = quantized.time();
+        }
+        if (exact.good() && exact.time() == t) {
+            exact_changes += exact.read_step(exact_conc);
+        }
+        if (quantized.good() && quantized.time() == t) {
+            quantized_changes += quantized.read_step(quantized_conc);
+        }
+
+        int step_max = 0;
+        double step_sum = 0;
+        for (auto const &cell : exact_conc) {
+            auto q = quantized_conc.find(cell.first);
+            int error = abs(cell.second - ((q == quantized_conc.end())? cell.second : q->second));
+            step_max = max(step_max, error);
+            step_sum += error;
+            sum_squared += (double) error * error;
+            samples++;
+        }
+        if (step_max > max_error) {
+            max_error = step_max;
+            max_error_time = t;
+        }
+        if (series) {
+            cout << t << "," << step_max << "," << (exact_conc.empty()? 0 : step_sum / exact_conc.size()) << endl;
+        }
+    }
+
+    if (!series) {
+        cout << "State changes (exact): " << exact_changes << endl;
+        cout << "State changes (quantized): " << quantized_changes << endl;
+        if (exact_changes > 0) {
+            cout << "Event reduction: " << 100.0 * (1.0 - (double) quantized_changes / exact_changes) << "%" << endl;
+        }
+        cout << "Max absolute error (ppm): " << max_error << " at time " << max_error_time << endl;
+        cout << "RMS error (ppm): " << (samples > 0? sqrt(sum_squared / samples) : 0) << endl;
+    }
+    return 0;
+}
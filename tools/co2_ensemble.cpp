@@ -0,0 +1,251 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Ensemble runner: runs every point of a parameter sweep (times every seed) on the stencil engine,
+ * several runs at a time, and writes one table with the summary of each run.
+ *
+ * The sweep spec is a JSON file:
+ *   {
+ *     "scenario": "grocery.map",        scenario file, relative to the spec file
+ *     "time": 500,                      simulation time of every run
+ *     "seeds": [1, 2, 3],               replicates of every point (default: [1])
+ *     "metrics_interval": 10,           time between two samples of the peaks (default: 10)
+ *     "threshold": 1000,                CO2 concentration counted by cells_above (default: 1000)
+ *     "sweep": {"totalStudents": [10, 25, 50], "resp_time": [1, 5], "vent_conc": [300], "window_conc": [400, 350]}
+ *   }
+ * Every combination of the values in "sweep" is a point; the other CO2_cell parameters come from the scenario.
+ * The layout is read once and shared by all the runs, and each run owns its model (cells, shoppers, metrics).
+ */
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/program_options.hpp>
+#include "../model/co2_metrics.hpp"
+#include "../model/co2_stencil.hpp"
+#include "../model/thread_pool.hpp"
+
+using namespace std;
+
+// One simulation of the ensemble
+struct ensemble_run {
+    vector<pair<string, double>> parameters; //Swept parameters of the point
+    conc config;
+    uint64_t seed = 1;
+
+    // Results
+    bool failed = false;
+    string error;
+    double mean_co2 = 0;
+    int max_co2 = 0;
+    double peak_mean_co2 = 0;
+    int peak_max_co2 = 0;
+    long peak_cells_above = 0;
+    long peak_occupied = 0;
+    int shoppers = 0;
+    long state_changes = 0;
+    double wall_seconds = 0;
+};
+
+/*
+ * Set one CO2_cell parameter by name
+ */
+void set_parameter(conc &config, string const &name, double value) {
+    if (name == "conc_increase") config.conc_increase = (float) value;
+    else if (name == "base") config.base = (int) value;
+    else if (name == "resp_time") config.resp_time = (int) value;
+    else if (name == "window_conc") config.window_conc = (int) value;
+    else if (name == "vent_conc") config.vent_conc = (int) value;
+    else if (name == "totalStudents") config.totalStudents = (int) value;
+    else if (name == "quantum") config.quantum = (int) value;
+    else throw invalid_argument("unknown CO2_cell parameter: " + name);
+}
+
+/*
+ * Every combination of the swept values, times every seed
+ */
+vector<ensemble_run> expand(json const &spec, conc const &base) {
+    vector<pair<string, vector<double>>> sweep;
+    if (spec.contains("sweep")) {
+        for (auto const &entry : spec.at("sweep").items()) {
+            sweep.emplace_back(entry.key(), entry.value().get<vector<double>>());
+            if (sweep.back().second.empty()) {
+                throw invalid_argument("no values for " + entry.key());
+            }
+        }
+    }
+    auto seeds = spec.contains("seeds")? spec.at("seeds").get<vector<uint64_t>>() : vector<uint64_t>{1};
+
+    vector<ensemble_run> runs;
+    vector<size_t> choice(sweep.size(), 0);
+    while (true) {
+        ensemble_run point;
+        point.config = base;
+        for (size_t i = 0; i < sweep.size(); i++) {
+            double value = sweep[i].second[choice[i]];
+            set_parameter(point.config, sweep[i].first, value);
+            point.parameters.emplace_back(sweep[i].first, value);
+        }
+        for (uint64_t seed : seeds) {
+            point.seed = seed;
+            runs.push_back(point);
+        }
+        //Next combination, the last parameter changes fastest
+        size_t i = sweep.size();
+        while (i > 0 && ++choice[i - 1] == sweep[i - 1].second.size()) {
+            choice[--i] = 0;
+        }
+        if (i == 0) {
+            break;
+        }
+    }
+    return runs;
+}
+
+void simulate(co2_scenario const &scenario, ensemble_run &run, float sim_time, double interval, int threshold) {
+    auto start = chrono::steady_clock::now();
+    co2_stencil stencil(scenario, run.config, 1);
+    stencil.agents().seed = run.seed;
+    co2_metrics metrics(interval, threshold);
+    stencil.run_until(sim_time, &metrics);
+    metrics.finish(sim_time);
+
+    run.mean_co2 = metrics.mean();
+    run.max_co2 = metrics.max();
+    run.peak_mean_co2 = metrics.peak_mean;
+    run.peak_max_co2 = metrics.peak_max;
+    run.peak_cells_above = metrics.peak_above_threshold;
+    run.peak_occupied = metrics.peak_occupied;
+    run.shoppers = stencil.agents().generated();
+    run.state_changes = stencil.state_changes;
+    run.wall_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char ** argv) {
+    namespace po = boost::program_options;
+    po::options_description options("Options");
+    options.add_options()
+        ("help,h", "print this message")
+        ("threads", po::value<int>()->default_value((int) std::max(1u, std::thread::hardware_concurrency())),
+            "number of runs at the same time")
+        ("output", po::value<std::string>(), "CSV file of the results (default: standard output)");
+    po::options_description arguments;
+    arguments.add_options()("spec", po::value<std::string>());
+    arguments.add(options);
+    po::positional_options_description positional;
+    positional.add("spec", 1);
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(arguments).positional(positional).run(), vm);
+        po::notify(vm);
+    } catch (po::error const &e) {
+        cout << e.what() << endl;
+        return -1;
+    }
+    if (vm.count("help") || !vm.count("spec")) {
+        cout << "Program used with wrong parameters. The program must be invoked as follows:";
+        cout << argv[0] << " SWEEP_SPEC.json [OPTIONS]" << endl;
+        cout << options << endl;
+        return -1;
+    }
+
+    std::string spec_path = vm["spec"].as<std::string>();
+    json spec;
+    co2_scenario scenario;
+    vector<ensemble_run> runs;
+    float sim_time;
+    double interval;
+    int threshold;
+    try {
+        ifstream in(spec_path);
+        if (!in) {
+            throw runtime_error("cannot open " + spec_path);
+        }
+        in >> spec;
+        std::string scenario_path = spec.at("scenario").get<std::string>();
+        auto slash = spec_path.find_last_of('/');
+        if (!scenario_path.empty() && scenario_path[0] != '/' && slash != std::string::npos) {
+            scenario_path = spec_path.substr(0, slash + 1) + scenario_path;
+        }
+        scenario = co2_scenario::from_file(scenario_path);
+        sim_time = spec.at("time").get<float>();
+        interval = spec.value("metrics_interval", 10.0);
+        threshold = spec.value("threshold", 1000);
+        runs = expand(spec, scenario.config);
+    } catch (std::exception const &e) {
+        cout << e.what() << endl;
+        return -1;
+    }
+
+    thread_pool pool(std::max(1, vm["threads"].as<int>()));
+    auto start = chrono::steady_clock::now();
+    pool.run((int) runs.size(), [&](int i) {
+        try {
+            simulate(scenario, runs[i], sim_time, interval, threshold);
+        } catch (std::exception const &e) {
+            runs[i].failed = true;
+            runs[i].error = e.what();
+        }
+    });
+    double wall = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    ofstream file;
+    if (vm.count("output")) {
+        file.open(vm["output"].as<std::string>());
+    }
+    ostream &out = vm.count("output")? file : cout;
+    out << "run";
+    if (!runs.empty()) {
+        for (auto const &parameter : runs[0].parameters) {
+            out << "," << parameter.first;
+        }
+    }
+    out << ",seed,mean_co2,max_co2,peak_mean_co2,peak_max_co2,peak_cells_above_" << threshold
+        << ",peak_occupied_cells,shoppers,state_changes,wall_seconds" << endl;
+    int failures = 0;
+    for (size_t i = 0; i < runs.size(); i++) {
+        ensemble_run const &r = runs[i];
+        if (r.failed) {
+            cerr << "run " << i << ": " << r.error << endl;
+            failures++;
+            continue;
+        }
+        out << i;
+        for (auto const &parameter : r.parameters) {
+            out << "," << parameter.second;
+        }
+        out << "," << r.seed << "," << r.mean_co2 << "," << r.max_co2 << "," << r.peak_mean_co2 << "," << r.peak_max_co2
+            << "," << r.peak_cells_above << "," << r.peak_occupied << "," << r.shoppers << "," << r.state_changes
+            << "," << r.wall_seconds << endl;
+    }
+    cerr << runs.size() << " runs on " << pool.size() << " threads in " << wall << " s" << endl;
+    return failures > 0? 1 : 0;
+}
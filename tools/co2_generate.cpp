@@ -0,0 +1,240 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Generates grocery store layouts of any size, in the raster (.map) or the JSON format.
+ *
+ * The store is surrounded by walls, with groups of windows on the wall x = 0 and groups of 4 doors on the wall
+ * x = width - 1; the shoppers come in and leave through the first door. Aisles are shelves along x, split in
+ * segments by cross aisles, and every segment belongs to one shopping area (DAILYUSE, FOODS, DRINKS in turn).
+ * Vents take the place of 2 shelf cells, so they never block a walkway.
+ *
+ * With a depth the store is a 3D volume (JSON format only): the doors and windows are 3 cells tall, the shopping
+ * areas stay on the floor (z = 0) with solid shelves stacked on them up to the shelf height, and the vents hang
+ * from the ceiling (z = depth - 1) above the shelves.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <boost/program_options.hpp>
+#include "../model/co2_scenario.hpp"
+
+using namespace std;
+
+struct store_parameters {
+    int width;
+    int height;
+    int depth;
+    int shelf_height; //Cells from the floor to the top of the shelves
+    int aisles;
+    int segments; //Shelf segments per aisle
+    int shoppers;
+    int doors;
+    int windows;
+    int vents;
+};
+
+/*
+ * Evenly spread positions of n groups of the given size over [first, last)
+ */
+vector<int> spread(int n, int size, int first, int last) {
+    vector<int> res;
+    int room = last - first - size;
+    for (int i = 0; i < n && room >= 0; i++) {
+        res.push_back(first + (n == 1? room / 2 : (int) ((long) room * i / (n - 1))));
+    }
+    return res;
+}
+
+co2_scenario generate(store_parameters const &p) {
+    co2 air(-1, 500, AIR);
+    json header = {
+        {"shape", (p.depth > 1)? json{p.width, p.height, p.depth} : json{p.width, p.height}},
+        {"wrapped", false},
+        {"default_delay", "transport"},
+        {"default_cell_type", "CO2_cell"},
+        {"default_state", air},
+        {"default_config", {{"CO2_cell", {{"conc_increase", 121.6}, {"base", 500}, {"resp_time", 1}, {"window_conc", 400},
+                                          {"vent_conc", 300}, {"totalStudents", p.shoppers}, {"quantum", 0}}}}},
+        {"neighborhood", {{{"type", "von_neumann"}, {"range", 1}}}}
+    };
+    co2_scenario s;
+    s.width = p.width;
+    s.height = p.height;
+    s.depth = p.depth;
+    s.scenario = header;
+    s.config = header.at("default_config").at("CO2_cell").get<conc>();
+    s.cells.assign((size_t) p.width * p.height * p.depth, air);
+
+    int opening = std::min(p.depth, 3); //Height of the doors and windows
+    for (int x = 0; x < p.width; x++) {
+        for (int y = 0; y < p.height; y++) {
+            if (x == 0 || y == 0 || x == p.width - 1 || y == p.height - 1) {
+                for (int z = 0; z < p.depth; z++) {
+                    s.at(x, y, z) = co2(-1, 0, IMPERMEABLE_STRUCTURE);
+                }
+            }
+        }
+    }
+    for (int y : spread(p.windows, 3, 1, p.height - 1)) {
+        for (int i = 0; i < 3; i++) {
+            for (int z = 0; z < opening; z++) {
+                s.at(0, y + i, z) = co2(-1, 400, WINDOW);
+            }
+        }
+    }
+    for (int y : spread(p.doors, 4, 1, p.height - 1)) {
+        for (int i = 0; i < 4; i++) {
+            for (int z = 0; z < opening; z++) {
+                s.at(p.width - 1, y + i, z) = co2(-1, 500, DOOR);
+            }
+        }
+    }
+
+    //Shelves from x = 2 to x = width - 4, leaving walkways along the walls and in front of the doors
+    int first_x = 2;
+    int last_x = p.width - 4;
+    int length = last_x - first_x;
+    int gap = 2; //Width of the cross aisles
+    int segment = (length - (p.segments - 1) * gap) / p.segments;
+    CELL_TYPE areas[3] = {DAILYUSE, FOODS, DRINKS};
+    vector<pair<int,int>> shelves;
+    int area = 0;
+    for (int y : spread(p.aisles, 1, 2, p.height - 2)) {
+        for (int k = 0; k < p.segments; k++) {
+            int x0 = first_x + k * (segment + gap);
+            for (int x = x0; x < x0 + segment; x++) {
+                s.at(x, y) = co2(0, 500, areas[area % 3]);
+                for (int z = 1; z < p.shelf_height; z++) {
+                    s.at(x, y, z) = co2(-1, 0, IMPERMEABLE_STRUCTURE);
+                }
+                shelves.emplace_back(x, y);
+            }
+            area++;
+        }
+    }
+    if (!shelves.empty()) {
+        int z = p.depth - 1;
+        for (int v = 0; v < p.vents; v++) {
+            auto const &cell = shelves[(long) shelves.size() * v / p.vents + (long) shelves.size() / (2 * p.vents)];
+            s.at(cell.first, cell.second, z) = co2(-1, 300, VENTILATION);
+            if (cell.first + 1 < last_x && s.at(cell.first + 1, cell.second).type != AIR) {
+                s.at(cell.first + 1, cell.second, z) = co2(-1, 300, VENTILATION);
+            }
+        }
+    }
+    return s;
+}
+
+int main(int argc, char ** argv) {
+    namespace po = boost::program_options;
+    po::options_description options("Options");
+    options.add_options()
+        ("help,h", "print this message")
+        ("width", po::value<int>()->default_value(25), "cells along x (the doors are on the wall x = width - 1)")
+        ("height", po::value<int>()->default_value(30), "cells along y")
+        ("depth", po::value<int>()->default_value(1), "cells along z, from the floor to the ceiling (1 for a 2D store)")
+        ("shelf-height", po::value<int>(), "height of the shelves in cells (default: half the depth)")
+        ("aisles", po::value<int>(), "number of shelves (default: one every 4 cells)")
+        ("segments", po::value<int>(), "shelf segments per aisle, i.e. cross aisles + 1 (default: one every 20 cells)")
+        ("shoppers", po::value<int>()->default_value(25), "total shoppers (totalStudents)")
+        ("doors", po::value<int>()->default_value(1), "groups of 4 doors")
+        ("windows", po::value<int>()->default_value(2), "groups of 3 windows")
+        ("vents", po::value<int>(), "number of vents (default: one per 100 shelf cells)");
+    po::options_description arguments;
+    arguments.add_options()("output", po::value<std::string>());
+    arguments.add(options);
+    po::positional_options_description positional;
+    positional.add("output", 1);
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(arguments).positional(positional).run(), vm);
+        po::notify(vm);
+    } catch (po::error const &e) {
+        cout << e.what() << endl;
+        return -1;
+    }
+    if (vm.count("help") || !vm.count("output")) {
+        cout << "Program used with wrong parameters. The program must be invoked as follows:";
+        cout << argv[0] << " OUTPUT.map|OUTPUT.json [OPTIONS]" << endl;
+        cout << options << endl;
+        return -1;
+    }
+
+    store_parameters p{};
+    p.width = vm["width"].as<int>();
+    p.height = vm["height"].as<int>();
+    p.depth = vm["depth"].as<int>();
+    if (p.width < 10 || p.height < 10 || p.depth < 1) {
+        cout << "The store must be at least 10 x 10 cells" << endl;
+        return -1;
+    }
+    p.shelf_height = vm.count("shelf-height")? vm["shelf-height"].as<int>() : std::max(1, p.depth / 2);
+    if (p.shelf_height < 1 || (p.depth > 1 && p.shelf_height >= p.depth)) {
+        cout << "The shelves must be lower than the ceiling" << endl;
+        return -1;
+    }
+    p.aisles = vm.count("aisles")? vm["aisles"].as<int>() : std::max(1, (p.height - 4) / 4);
+    p.segments = vm.count("segments")? vm["segments"].as<int>() : std::max(1, (p.width - 6) / 20);
+    p.shoppers = vm["shoppers"].as<int>();
+    p.doors = vm["doors"].as<int>();
+    p.windows = vm["windows"].as<int>();
+    if (p.aisles < 0 || p.aisles > (p.height - 4) / 2 || p.segments < 1 || p.segments > (p.width - 6) / 3) {
+        cout << "Too many aisles or segments for a " << p.width << " x " << p.height << " store" << endl;
+        return -1;
+    }
+    if (p.doors < 1 || p.doors * 4 > p.height - 2 || p.windows < 0 || p.windows * 3 > p.height - 2) {
+        cout << "The doors and windows do not fit in the walls" << endl;
+        return -1;
+    }
+    int shelf_cells = p.aisles * p.segments * ((p.width - 6 - (p.segments - 1) * 2) / p.segments);
+    p.vents = vm.count("vents")? vm["vents"].as<int>() : shelf_cells / 100;
+    if (p.vents < 0 || (p.vents > 0 && p.vents * 2 > shelf_cells)) {
+        cout << "Too many vents for the shelves" << endl;
+        return -1;
+    }
+
+    std::string output = vm["output"].as<std::string>();
+    if (p.depth > 1 && co2_scenario::is_raster(output)) {
+        cout << "3D stores can only be written in the JSON format" << endl;
+        return -1;
+    }
+    co2_scenario scenario = generate(p);
+    ofstream out(output);
+    if (!out) {
+        cout << "cannot open " << output << endl;
+        return -1;
+    }
+    if (co2_scenario::is_raster(output)) {
+        scenario.write_raster(out);
+    } else {
+        out << scenario.to_json().dump(4) << endl;
+    }
+    return 0;
+}
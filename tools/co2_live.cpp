@@ -0,0 +1,172 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Viewer of the live stream of a running simulation (co2_lab --live): prints a summary of every frame, draws the
+ * floor of the store every N frames and records the states in the text format of results/state.txt.
+ */
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <boost/program_options.hpp>
+#include "../model/live_stream.hpp"
+
+using namespace std;
+
+/*
+ * Draw the floor (z = 0): walls and other static cells by type, shoppers as 'S', the air by concentration
+ */
+void render(live_stream_reader const &live) {
+    static const string levels = " .:-=+*%@";
+    for (int x = 0; x < live.width; x++) {
+        string row;
+        for (int y = 0; y < live.height; y++) {
+            co2 const &s = live.state(x, y);
+            switch (s.type) {
+                case IMPERMEABLE_STRUCTURE: row += '#'; break;
+                case DOOR: row += 'D'; break;
+                case WINDOW: row += 'W'; break;
+                case VENTILATION: row += 'V'; break;
+                case CO2_SOURCE: row += 'S'; break;
+                default: {
+                    int level = std::max(0, std::min((int) levels.size() - 1, (s.concentration - 400) / 200));
+                    row += levels[level];
+                }
+            }
+        }
+        cout << row << '\n';
+    }
+    cout << endl;
+}
+
+int main(int argc, char ** argv) {
+    namespace po = boost::program_options;
+    po::options_description options("Options");
+    options.add_options()
+        ("help,h", "print this message")
+        ("record", po::value<std::string>(), "write the states to this file, in the format of results/state.txt")
+        ("render", po::value<int>()->default_value(0), "draw the floor of the store every N frames (0 for never)")
+        ("wait", po::value<double>()->default_value(10), "seconds to wait for the simulation to start");
+    po::options_description arguments;
+    arguments.add_options()("name", po::value<std::string>()->default_value("/co2_live"));
+    arguments.add(options);
+    po::positional_options_description positional;
+    positional.add("name", 1);
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(arguments).positional(positional).run(), vm);
+        po::notify(vm);
+    } catch (po::error const &e) {
+        cout << e.what() << endl;
+        return -1;
+    }
+    if (vm.count("help")) {
+        cout << "Program used with wrong parameters. The program must be invoked as follows:";
+        cout << argv[0] << " [NAME (default: /co2_live)] [OPTIONS]" << endl;
+        cout << options << endl;
+        return -1;
+    }
+    std::string name = vm["name"].as<std::string>();
+    int render_every = vm["render"].as<int>();
+
+    std::unique_ptr<live_stream_reader> live;
+    auto deadline = chrono::steady_clock::now() + chrono::duration<double>(vm["wait"].as<double>());
+    while (live == nullptr) {
+        try {
+            live = std::make_unique<live_stream_reader>(name);
+        } catch (std::runtime_error const &e) {
+            if (chrono::steady_clock::now() > deadline) {
+                cerr << e.what() << endl;
+                return -1;
+            }
+            this_thread::sleep_for(chrono::milliseconds(50));
+        }
+    }
+
+    std::ofstream record;
+    if (vm.count("record")) {
+        record.open(vm["record"].as<std::string>());
+        if (!record) {
+            cerr << "cannot open " << vm["record"].as<std::string>() << endl;
+            return -1;
+        }
+    }
+    bool three_d = live->depth > 1;
+    bool has_time = false;
+    double last_time = 0;
+    long frames = 0;
+    cout << "time,cells,merged_steps,mean_co2,shoppers" << endl;
+    while (true) {
+        if (!live->next()) {
+            if (live->finished()) {
+                break;
+            }
+            this_thread::sleep_for(chrono::milliseconds(5));
+            continue;
+        }
+        frames++;
+        long air = 0;
+        long shoppers = 0;
+        double sum = 0;
+        for (int x = 0; x < live->width; x++) {
+            for (int y = 0; y < live->height; y++) {
+                for (int z = 0; z < live->depth; z++) {
+                    co2 const &s = live->state(x, y, z);
+                    if (s.type == AIR || s.type == CO2_SOURCE) {
+                        air++;
+                        sum += s.concentration;
+                        shoppers += (s.type == CO2_SOURCE)? 1 : 0;
+                    }
+                }
+            }
+        }
+        cout << live->frame_time << "," << live->changed.size() << "," << live->merged << ","
+             << ((air > 0)? sum / air : 0) << "," << shoppers << endl;
+        if (render_every > 0 && frames % render_every == 0) {
+            render(*live);
+        }
+        if (record.is_open()) {
+            if (!has_time || live->frame_time != last_time) {
+                record << live->frame_time << '\n';
+                has_time = true;
+                last_time = live->frame_time;
+            }
+            for (int i : live->changed) {
+                int z = i % live->depth;
+                int x = i / live->depth / live->height;
+                int y = i / live->depth % live->height;
+                text_state_log::write(record, x, y, z, three_d, live->state(x, y, z));
+            }
+        }
+    }
+    cerr << "Frames: " << frames << " (time steps merged by the simulation: " << live->merged_steps() << ")" << endl;
+    return 0;
+}
@@ -0,0 +1,94 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Converts a binary state log (co2_lab --log binary) to the text format of results/state.txt.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "../model/binary_state_log.hpp"
+#include "../model/co2_observers.hpp"
+
+using namespace std;
+
+/*
+ * Write the state of every cell at the given time
+ */
+void write_snapshot(binary_state_reader const &log, double time) {
+    cout << time << endl;
+    for (int x = 0; x < log.width; x++) {
+        for (int y = 0; y < log.height; y++) {
+            for (int z = 0; z < log.depth; z++) {
+                text_state_log::write(cout, x, y, z, log.depth > 1, log.state(x, y, z));
+            }
+        }
+    }
+}
+
+int main(int argc, char ** argv) {
+    if (argc < 2 || (argc > 2 && (string(argv[2]) != "--from" || argc < 4))) {
+        cout << "Program used with wrong parameters. The program must be invoked as follows:";
+        cout << argv[0] << " STATE.bin [--from TIME]" << endl;
+        return -1;
+    }
+
+    try {
+        binary_state_reader log(argv[1]);
+        if (argc > 2) {
+            //Full state at the given time, then the changes after it
+            double from = atof(argv[3]);
+            log.seek(from);
+            while (log.next_time() <= from) {
+                log.next();
+            }
+            write_snapshot(log, from);
+        } else if (log.next()) {
+            write_snapshot(log, log.frame_time);
+        }
+        double last_time = log.frame_time;
+        while (log.next()) {
+            if (log.keyframe) {
+                continue;
+            }
+            if (log.frame_time != last_time) {
+                cout << log.frame_time << endl;
+                last_time = log.frame_time;
+            }
+            for (int i : log.changed) {
+                int z = i % log.depth;
+                int x = i / log.depth / log.height;
+                int y = i / log.depth % log.height;
+                text_state_log::write(cout, x, y, z, log.depth > 1, log.state(x, y, z));
+            }
+        }
+    } catch (std::exception const &e) {
+        cerr << e.what() << endl;
+        return -1;
+    }
+    return 0;
+}
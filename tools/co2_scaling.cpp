@@ -0,0 +1,106 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Scaling benchmark of the multithreaded stencil engine: runs the same scenario with 1 to N threads,
+ * reports the wall time and speedup of every run and checks that all of them end in the same state.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "../model/co2_stencil.hpp"
+
+using namespace std;
+
+/*
+ * Repeat the layout of the scenario n x n times to get a bigger store
+ */
+co2_scenario repeat(co2_scenario const &scenario, int n) {
+    co2_scenario res;
+    res.width = scenario.width * n;
+    res.height = scenario.height * n;
+    res.config = scenario.config;
+    res.cells.resize(res.width * res.height);
+    for (int x = 0; x < res.width; x++) {
+        for (int y = 0; y < res.height; y++) {
+            res.at(x, y) = scenario.at(x % scenario.width, y % scenario.height);
+        }
+    }
+    return res;
+}
+
+/*
+ * FNV-1a hash of the state of every cell
+ */
+uint64_t checksum(co2_stencil const &stencil) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (int x = 0; x < stencil.get_width(); x++) {
+        for (int y = 0; y < stencil.get_height(); y++) {
+            co2 const &s = stencil.state(x, y);
+            for (int v : {s.counter, s.concentration, (int) s.type}) {
+                hash = (hash ^ (uint32_t) v) * 1099511628211ULL;
+            }
+        }
+    }
+    return hash;
+}
+
+int main(int argc, char ** argv) {
+    if (argc < 2) {
+        cout << "Program used with wrong parameters. The program must be invoked as follows:";
+        cout << argv[0] << " SCENARIO_CONFIG.json|LAYOUT.map [MAX_SIMULATION_TIME (default: 500)] [MAX_THREADS (default: all cores)] [REPEAT (default: 20)]" << endl;
+        return -1;
+    }
+    float sim_time = (argc > 2)? atof(argv[2]) : 500;
+    int max_threads = (argc > 3)? atoi(argv[3]) : (int) max(1u, thread::hardware_concurrency());
+    int n = (argc > 4)? atoi(argv[4]) : 20;
+    co2_scenario scenario = repeat(co2_scenario::from_file(argv[1]), n);
+
+    cout << "cells,threads,wall_seconds,speedup,computations,checksum,identical" << endl;
+    double serial = 0;
+    uint64_t reference = 0;
+    bool all_identical = true;
+    for (int threads = 1; threads <= max_threads; threads++) {
+        co2_stencil stencil(scenario, threads);
+        stencil.agents().seed = 1;
+        auto start = chrono::steady_clock::now();
+        stencil.run_until(sim_time, nullptr);
+        double wall = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        uint64_t hash = checksum(stencil);
+        if (threads == 1) {
+            serial = wall;
+            reference = hash;
+        }
+        all_identical = all_identical && hash == reference;
+        cout << scenario.width * scenario.height << "," << threads << "," << wall << "," << serial / wall << ","
+             << stencil.computations << "," << hex << hash << dec << "," << (hash == reference? "yes" : "no") << endl;
+    }
+    return all_identical? 0 : 1;
+}
@@ -0,0 +1,163 @@
+/**
+ * Copyright (c) 2020, Cristina Ruiz Martin
+ * ARSLab - Carleton University
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Scheduler benchmark: replays the transport-delay publications of the cells (every cell publishes again 1 or
+ * resp_time ticks after its last publication) on a binary heap with float times, the scheduler of the float
+ * runner, on the same heap with double times, and on the calendar queue with integer ticks of the stencil engine.
+ * Every scheduler processes the same number of events; the times they pop are checked against the exact ticks.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <queue>
+#include <string>
+#include <vector>
+#include <boost/program_options.hpp>
+#include "../model/calendar_queue.hpp"
+
+using namespace std;
+
+struct workload {
+    long cells;
+    co2_tick start; //Tick of the first publications, e.g. days into a run
+    co2_tick ticks;
+    int resp_time;
+    int source_every; //One cell in source_every is a CO2 source, with delay resp_time
+
+    [[nodiscard]] int delay(int cell) const {
+        return (cell % source_every == 0)? resp_time : 1;
+    }
+};
+
+struct result {
+    long events = 0;
+    double seconds = 0;
+    co2_tick last = 0; //Time of the last event, as an integer
+    uint64_t checksum = 0; //Hash of the times of all the events
+};
+
+void count(result &r, co2_tick time) {
+    r.events++;
+    r.last = time;
+    r.checksum = (r.checksum ^ (uint64_t) time) * 1099511628211ULL;
+}
+
+/*
+ * Calendar queue with integer ticks, run until the end of the workload
+ */
+result run_calendar(workload const &w) {
+    result r;
+    auto begin = chrono::steady_clock::now();
+    calendar_queue<int> pending;
+    for (int cell = 0; cell < w.cells; cell++) {
+        pending.push(w.start, cell);
+    }
+    while (pending.next_time() < w.start + w.ticks) {
+        co2_tick time = pending.next_time();
+        int cell = pending.top();
+        pending.pop();
+        count(r, time);
+        pending.push(time + w.delay(cell), cell);
+    }
+    r.seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    return r;
+}
+
+/*
+ * Binary heap ordered by time and sequence (the order of the Cadmium simulators), for the given number of events
+ */
+template <typename TIME>
+result run_heap(workload const &w, long events) {
+    struct event {
+        TIME time;
+        long sequence;
+        int cell;
+    };
+    struct later {
+        bool operator()(event const &a, event const &b) const {
+            return a.time > b.time || (a.time == b.time && a.sequence > b.sequence);
+        }
+    };
+    result r;
+    auto begin = chrono::steady_clock::now();
+    std::priority_queue<event, std::vector<event>, later> pending;
+    long sequence = 0;
+    for (int cell = 0; cell < w.cells; cell++) {
+        pending.push({(TIME) w.start, sequence++, cell});
+    }
+    while (r.events < events) {
+        event e = pending.top();
+        pending.pop();
+        count(r, (co2_tick) e.time);
+        pending.push({e.time + (TIME) w.delay(e.cell), sequence++, e.cell});
+    }
+    r.seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    return r;
+}
+
+int main(int argc, char ** argv) {
+    namespace po = boost::program_options;
+    po::options_description options("Options");
+    options.add_options()
+        ("help,h", "print this message")
+        ("cells", po::value<long>()->default_value(100000), "cells publishing")
+        ("ticks", po::value<co2_tick>()->default_value(1000), "time units to simulate")
+        ("start", po::value<co2_tick>()->default_value(0), "time of the first publication (e.g. 17280000 for 200 days of seconds)")
+        ("resp-time", po::value<int>()->default_value(5), "delay of the CO2 sources")
+        ("source-every", po::value<int>()->default_value(20), "one cell in N is a CO2 source");
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, options), vm);
+        po::notify(vm);
+    } catch (po::error const &e) {
+        cout << e.what() << endl;
+        return -1;
+    }
+    if (vm.count("help")) {
+        cout << "Program used with wrong parameters. The program must be invoked as follows:";
+        cout << argv[0] << " [OPTIONS]" << endl;
+        cout << options << endl;
+        return -1;
+    }
+    workload w{vm["cells"].as<long>(), vm["start"].as<co2_tick>(), vm["ticks"].as<co2_tick>(),
+               std::max(1, vm["resp-time"].as<int>()), std::max(1, vm["source-every"].as<int>())};
+
+    result exact = run_calendar(w);
+    vector<pair<string, result>> results = {
+        {"heap_float", run_heap<float>(w, exact.events)},
+        {"heap_double", run_heap<double>(w, exact.events)},
+        {"calendar_tick", exact}
+    };
+    cout << "scheduler,events,seconds,events_per_second,last_time,exact" << endl;
+    for (auto const &r : results) {
+        cout << r.first << "," << r.second.events << "," << r.second.seconds << ","
+             << ((r.second.seconds > 0)? r.second.events / r.second.seconds : 0) << "," << r.second.last << ","
+             << ((r.second.checksum == exact.checksum && r.second.last == exact.last)? "yes" : "no") << endl;
+    }
+    return 0;
+}